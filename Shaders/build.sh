@@ -1,3 +1,6 @@
 #!/bin/bash
 glslangValidator -V shader.vert
 glslangValidator -V shader.frag
+glslangValidator -V cull.comp -o cull.spv
+glslangValidator -V hiz.comp -o hiz.spv
+glslangValidator -V translucent.frag -o translucent.spv
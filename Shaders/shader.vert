@@ -9,6 +9,7 @@ layout (push_constant) uniform MVP {
 
 layout (location = 0) in vec3 inPos;
 layout (location = 1) in vec3 inColor;
+layout (location = 2) in vec3 inOrigin;
 
 layout (location = 0) out vec3 fragColor;
 
@@ -17,6 +18,6 @@ out gl_PerVertex {
 };
 
 void main() {
-    gl_Position = mvp.proj * mvp.view * mvp.model * vec4(inPos, 1.0);
+    gl_Position = mvp.proj * mvp.view * mvp.model * vec4(inPos + inOrigin, 1.0);
     fragColor = inColor;
 }
@@ -0,0 +1,13 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout (location = 0) out vec4 outColor;
+
+layout (location = 0) in vec3 fragColor;
+
+// Blended over what is behind, see-through blocks keep their colour at half strength
+const float ALPHA = 0.5;
+
+void main() {
+    outColor = vec4(fragColor, ALPHA);
+}
\ No newline at end of file
@@ -0,0 +1,20 @@
+# Writes a SPIR-V module out as a constexpr array of words, so it can be built into the binary.
+# Usage: cmake -DINPUT=<module.spv> -DOUTPUT=<header> -DNAME=<array name> -P EmbedSpirv.cmake
+
+file(READ "${INPUT}" hex HEX)
+string(LENGTH "${hex}" length)
+math(EXPR remainder "${length} % 8")
+if(length EQUAL 0 OR NOT remainder EQUAL 0)
+    message(FATAL_ERROR "${INPUT} is not a whole number of SPIR-V words")
+endif()
+
+# Words are stored little endian, eight to a line
+string(REGEX REPLACE "(..)(..)(..)(..)" "0x\\4\\3\\2\\1," words "${hex}")
+set(word "0x[0-9a-f]+,")
+string(REGEX REPLACE "(${word}${word}${word}${word}${word}${word}${word}${word})" "\\1\n    " words "${words}")
+
+file(WRITE "${OUTPUT}"
+    "#pragma once\n\n"
+    "#include <cstdint>\n\n"
+    "// Generated from ${INPUT}\n"
+    "constexpr uint32_t ${NAME}[] = {\n    ${words}\n};\n")
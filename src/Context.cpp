@@ -1,13 +1,16 @@
 #include "Context.h"
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <set>
 #include <chrono>
+#include <cstring>
+#include <thread>
 
 #include "Window.h"
-#include "Shader/Shader.h"
 #include "Threads/Scheduler.h"
+#include "Trace/Trace.h"
 
 namespace {
     VkResult CreateDebugReportCallbackEXT(VkInstance instance,
@@ -38,12 +41,18 @@ VkBool32 Context::debugCallback(VkDebugReportFlagsEXT flags,
     return VK_FALSE;
 }
 
-void Context::init(Window& window, bool debug) {
+void Context::init(Window* window, VkExtent2D extent, bool debug) {
+    // Offscreen rendering never presents, so it needs neither the surface nor the swap chain
+    m_headless = window == nullptr;
+    if (m_headless)
+        m_deviceExtensions.clear();
+
     // Create the Vulkan instance
     createInstance(debug);
 
     // Create the presentation surface for GLFW
-    createSurface(window);
+    if (window)
+        createSurface(*window);
 
     // Set the callback for the Debug Validation Layers if needed
     if (debug)
@@ -51,62 +60,75 @@ void Context::init(Window& window, bool debug) {
 
     selectPhysicalDevice();
     createLogicalDevice(debug);
-    createSwapChain(window);
+    createPipelineCache();
+    if (window)
+        createSwapChain(*window);
+    else
+        createOffscreenImages(extent);
     createImageViews();
+    createDepthImage();
     createRenderPass();
     createDescriptorSetLayout();
-    createPipeline();
+    createPipelineLayout();
     createFramebuffers();
-    createCommandPool();
-    createVertexBuffer();
-    createIndexBuffer();
+    createStagingBuffer();
     createUniformBuffer();
     createDescriptorPool();
     createDescriptorSet();
-    createSemaphores();
+    createFrames();
 }
 
-Context::Context(Window& window, bool debug) {
-    init(window, debug);
+Context::Context(Window& window, bool debug) : Context(&window, {}, debug) {}
+
+Context::Context(Window* window, VkExtent2D extent, bool debug) {
+    init(window, extent, debug);
 }
 
 Context::~Context() {
-    vkDestroySemaphore(m_device, m_imageAvailable, nullptr);
-    vkDestroySemaphore(m_device, m_renderFinished, nullptr);
-
-    vkDestroyCommandPool(m_device, m_commandPool, nullptr);
+    vkDeviceWaitIdle(m_device);
+
+    for (auto& frame : m_frames) {
+        vkDestroySemaphore(m_device, frame.imageAvailable, nullptr);
+        vkDestroySemaphore(m_device, frame.renderFinished, nullptr);
+        vkDestroyFence(m_device, frame.inFlight, nullptr);
+        vkDestroySemaphore(m_device, frame.uploadFinished, nullptr);
+        for (auto& pool : frame.commandPools)
+            vkDestroyCommandPool(m_device, pool.pool, nullptr);
+        vkDestroyCommandPool(m_device, frame.transferPool, nullptr);
+    }
 
     for (auto& framebuffer : m_swapChainFramebuffers)
         vkDestroyFramebuffer(m_device, framebuffer, nullptr);
 
-    vkDestroyPipeline(m_device, m_grahicsPipeline, nullptr);
     vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
     vkDestroyRenderPass(m_device, m_renderPass, nullptr);
 
     for (auto& imageView : m_swapChainImageViews)
         vkDestroyImageView(m_device, imageView, nullptr);
+    vkDestroyImageView(m_device, m_depthView, nullptr);
+    destroyImage(m_depthImage);
 
-    vkDestroySwapchainKHR(m_device, m_swapChain, nullptr);
+    if (!m_headless)
+        vkDestroySwapchainKHR(m_device, m_swapChain, nullptr);
+    for (auto& image : m_offscreenImages)
+        destroyImage(image);
 
     vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
 
     vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, nullptr);
 
-    vkUnmapMemory(m_device, m_vertexBufferMem);
-    m_vertexBufferMappedMem = nullptr;
-    vkDestroyBuffer(m_device, m_vertexBuffer, nullptr);
-    vkFreeMemory(m_device, m_vertexBufferMem, nullptr);
-
-    vkUnmapMemory(m_device, m_indexBufferMem);
-    m_indexBufferMappedMem = nullptr;
-    vkDestroyBuffer(m_device, m_indexBuffer, nullptr);
-    vkFreeMemory(m_device, m_indexBufferMem, nullptr);
+    for (auto& [serial, buffer] : m_releases)
+        destroyBuffer(buffer.buffer, buffer.memory);
+    destroyBuffer(m_stagingBuffer.buffer, m_stagingBuffer.memory);
 
-    vkDestroyBuffer(m_device, m_uniformBuffer, nullptr);
-    vkFreeMemory(m_device, m_uniformBufferMem, nullptr);
+    destroyBuffer(m_uniformBuffer, m_uniformBufferMem);
 
+    m_pipelineCache->save();
+    m_pipelineCache.reset();
+    m_allocator.reset();
     vkDestroyDevice(m_device, nullptr);
-    vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
+    if (!m_headless)
+        vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
 
     DestroyDebugReportCallbackEXT(m_instance, m_debugReportCallback, nullptr);
     vkDestroyInstance(m_instance, nullptr);
@@ -123,11 +145,13 @@ void Context::createInstance(bool debug) {
         extensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
     }
 
-    // GLFW Extensions
-    unsigned int glfwExtCount = 0;
-    const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtCount);
-    for (auto i = 0; i < glfwExtCount; i++)
-        extensions.push_back(glfwExtensions[i]);
+    // GLFW Extensions, GLFW is never initialized without a window
+    if (!m_headless) {
+        unsigned int glfwExtCount = 0;
+        const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtCount);
+        for (auto i = 0; i < glfwExtCount; i++)
+            extensions.push_back(glfwExtensions[i]);
+    }
     instanceInfo.setExtensions(extensions);
 
     if (vkCreateInstance(&instanceInfo, nullptr, &m_instance) != VK_SUCCESS)
@@ -163,6 +187,8 @@ void Context::createLogicalDevice(bool debug) {
 
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
     std::set<int> uniqueQueueFamilies = {indices.graphics, indices.present};
+    if (indices.transfer >= 0)
+        uniqueQueueFamilies.insert(indices.transfer);
     float queuePriority = 1.0f;
     for (int queueFamily : uniqueQueueFamilies) {
         VkDeviceQueueCreateInfo queueCreateInfo = {};
@@ -174,7 +200,20 @@ void Context::createLogicalDevice(bool debug) {
     }
 
     VkDeviceCreateInfo createInfo = {};
+    VkPhysicalDeviceFeatures supportedFeatures = {};
+    vkGetPhysicalDeviceFeatures(m_physicalDevice, &supportedFeatures);
+
+    // Indirect chunk draws use these when available and fall back to per draw calls otherwise
     VkPhysicalDeviceFeatures deviceFeatures = {};
+    deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+    deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+    // Wireframe pipelines need it
+    deviceFeatures.fillModeNonSolid = supportedFeatures.fillModeNonSolid;
+    // Counting fragment shader invocations, for measuring overdraw
+    deviceFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
+    // Lets secondary command buffers run while that count is going
+    deviceFeatures.inheritedQueries = supportedFeatures.inheritedQueries;
+    m_features = deviceFeatures;
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
@@ -184,14 +223,35 @@ void Context::createLogicalDevice(bool debug) {
         createInfo.enabledLayerCount = static_cast<uint32_t>(m_validationLayers.size());
         createInfo.ppEnabledLayerNames = m_validationLayers.data();
     }
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(m_deviceExtensions.size());
-    createInfo.ppEnabledExtensionNames = m_deviceExtensions.data();
+
+    // Lets GPU culling compact its draws, it zeroes instance counts instead without it
+    std::vector<const char*> extensions = m_deviceExtensions;
+    bool drawIndirectCount = supportsDeviceExtensions(m_physicalDevice, {VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME});
+    if (drawIndirectCount)
+        extensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+    createInfo.ppEnabledExtensionNames = extensions.data();
 
     if (vkCreateDevice(m_physicalDevice, &createInfo, nullptr, &m_device) != VK_SUCCESS)
         throw std::runtime_error("Failed to create logical device!");
 
+    if (drawIndirectCount)
+        m_drawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+                vkGetDeviceProcAddr(m_device, "vkCmdDrawIndexedIndirectCountKHR"));
+
     vkGetDeviceQueue(m_device, static_cast<uint32_t>(indices.graphics), 0, &m_graphicsQueue);
     vkGetDeviceQueue(m_device, static_cast<uint32_t>(indices.present), 0, &m_presentQueue);
+
+    // Without a transfer only family uploads are recorded straight into the graphics command buffer
+    m_graphicsFamily = static_cast<uint32_t>(indices.graphics);
+    m_transferFamily = indices.transfer >= 0 ? static_cast<uint32_t>(indices.transfer) : m_graphicsFamily;
+    vkGetDeviceQueue(m_device, m_transferFamily, 0, &m_transferQueue);
+
+    m_allocator = std::make_unique<vk::Allocator>(m_physicalDevice, m_device);
+}
+
+void Context::createPipelineCache() {
+    m_pipelineCache = std::make_unique<vk::PipelineCache>(m_physicalDevice, m_device, PIPELINE_CACHE_PATH);
 }
 
 void Context::createSwapChain(Window& window) {
@@ -245,6 +305,32 @@ void Context::createSwapChain(Window& window) {
     m_swapChainExtent = extent;
 }
 
+void Context::createOffscreenImages(VkExtent2D extent) {
+    // One image per frame slot, a slot's fence is all that guards its image
+    VkImageCreateInfo imageInfo = {};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+    imageInfo.extent = {extent.width, extent.height, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        m_offscreenImages.push_back(createImage(imageInfo));
+        m_swapChainImages.push_back(m_offscreenImages.back().image);
+    }
+
+    m_swapChainFormat = imageInfo.format;
+    m_swapChainExtent = extent;
+    // Present layouts need the swap chain extension, offscreen frames are left ready to copy out
+    m_finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+}
+
 void Context::createImageViews() {
     m_swapChainImageViews.resize(m_swapChainImages.size());
 
@@ -269,6 +355,37 @@ void Context::createImageViews() {
     }
 }
 
+void Context::createDepthImage() {
+    m_depthFormat = selectDepthFormat();
+
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(m_physicalDevice, m_depthFormat, &properties);
+    m_depthSampled = (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+
+    VkImageCreateInfo imageInfo = {};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = m_depthFormat;
+    imageInfo.extent = {m_swapChainExtent.width, m_swapChainExtent.height, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | (m_depthSampled ? VK_IMAGE_USAGE_SAMPLED_BIT : 0);
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    m_depthImage = createImage(imageInfo);
+
+    VkImageViewCreateInfo viewInfo = {};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = m_depthImage.image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = m_depthFormat;
+    viewInfo.subresourceRange = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1};
+    if (vkCreateImageView(m_device, &viewInfo, nullptr, &m_depthView) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create depth image view!");
+}
+
 void Context::createRenderPass() {
     VkAttachmentDescription colorAttachment = {};
     colorAttachment.format = m_swapChainFormat;
@@ -278,29 +395,51 @@ void Context::createRenderPass() {
     colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    colorAttachment.finalLayout = m_finalLayout;
+
+    // Only kept past the pass when the occlusion pyramid can be built from it
+    VkAttachmentDescription depthAttachment = {};
+    depthAttachment.format = m_depthFormat;
+    depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthAttachment.storeOp = m_depthSampled ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    depthAttachment.finalLayout = m_depthSampled ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+                                                 : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
     VkAttachmentReference colorAttachmentRef = {};
     colorAttachmentRef.attachment = 0;
     colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+    VkAttachmentReference depthAttachmentRef = {};
+    depthAttachmentRef.attachment = 1;
+    depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
     VkSubpassDescription subpass = {};
     subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
     subpass.colorAttachmentCount = 1;
     subpass.pColorAttachments = &colorAttachmentRef;
+    subpass.pDepthStencilAttachment = &depthAttachmentRef;
 
+    // The depth image is shared, so the last frame's depth tests and pyramid build have to be done with it
     VkSubpassDependency dependency = {};
     dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
     dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
+    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+                              VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    dependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                               VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                               VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    std::array<VkAttachmentDescription, 2> attachments = {colorAttachment, depthAttachment};
     VkRenderPassCreateInfo renderPassInfo = {};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    renderPassInfo.attachmentCount = 1;
-    renderPassInfo.pAttachments = &colorAttachment;
+    renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+    renderPassInfo.pAttachments = attachments.data();
     renderPassInfo.subpassCount = 1;
     renderPassInfo.pSubpasses = &subpass;
     renderPassInfo.dependencyCount = 1;
@@ -327,123 +466,7 @@ void Context::createDescriptorSetLayout() {
         throw std::runtime_error("Failed to create descriptor set layout!");
 }
 
-void Context::createPipeline() {
-    Shader vert(m_device, "Shaders/vert.spv");
-    Shader frag(m_device, "Shaders/frag.spv");
-
-    VkPipelineShaderStageCreateInfo vertStageInfo = {};
-    vertStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    vertStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-    vertStageInfo.module = vert.module();
-    vertStageInfo.pName = "main";
-    VkPipelineShaderStageCreateInfo fragStageInfo = {};
-    fragStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    fragStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    fragStageInfo.module = frag.module();
-    fragStageInfo.pName = "main";
-    VkPipelineShaderStageCreateInfo shaderStages[] = {vertStageInfo, fragStageInfo};
-
-    VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
-    VkVertexInputBindingDescription bindingDescription = {};
-    bindingDescription.binding = 0;
-    bindingDescription.stride = 6 * sizeof(float);
-    bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-    VkVertexInputAttributeDescription attributeDescriptions[2] = {0};
-    attributeDescriptions[0].binding = 0;
-    attributeDescriptions[0].location = 0;
-    attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-    attributeDescriptions[0].offset = 0;
-
-    attributeDescriptions[1].binding = 0;
-    attributeDescriptions[1].location = 1;
-    attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-    attributeDescriptions[1].offset = 3 * sizeof(float);
-
-    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInputInfo.vertexBindingDescriptionCount = 1;
-    vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-    vertexInputInfo.vertexAttributeDescriptionCount = 2;
-    vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions;
-
-    VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo = {};
-    inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
-
-    VkViewport viewport = {};
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width = static_cast<float>(m_swapChainExtent.width);
-    viewport.height = static_cast<float>(m_swapChainExtent.height);
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-
-    VkRect2D scissor = {};
-    scissor.offset = {0, 0};
-    scissor.extent = m_swapChainExtent;
-
-    VkPipelineViewportStateCreateInfo viewportStateInfo = {};
-    viewportStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewportStateInfo.viewportCount = 1;
-    viewportStateInfo.pViewports = &viewport;
-    viewportStateInfo.scissorCount = 1;
-    viewportStateInfo.pScissors = &scissor;
-
-    VkPipelineRasterizationStateCreateInfo rasterizationStateInfo = {};
-    rasterizationStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterizationStateInfo.depthClampEnable = VK_FALSE;
-    rasterizationStateInfo.rasterizerDiscardEnable = VK_FALSE;
-    rasterizationStateInfo.polygonMode = VK_POLYGON_MODE_FILL;
-    rasterizationStateInfo.lineWidth = 1.0f;
-    rasterizationStateInfo.cullMode = VK_CULL_MODE_BACK_BIT;
-    rasterizationStateInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-    rasterizationStateInfo.depthBiasEnable = VK_FALSE;
-    rasterizationStateInfo.depthBiasConstantFactor = 0.0f;
-    rasterizationStateInfo.depthBiasClamp = 0.0f;
-    rasterizationStateInfo.depthBiasSlopeFactor = 0.0f;
-
-    VkPipelineMultisampleStateCreateInfo multisampleStateInfo = {};
-    multisampleStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisampleStateInfo.sampleShadingEnable = VK_FALSE;
-    multisampleStateInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-    multisampleStateInfo.minSampleShading = 1.0f;
-    multisampleStateInfo.pSampleMask = nullptr;
-    multisampleStateInfo.alphaToCoverageEnable = VK_FALSE;
-    multisampleStateInfo.alphaToOneEnable = VK_FALSE;
-
-    VkPipelineColorBlendAttachmentState colorBlendState = {};
-    colorBlendState.colorWriteMask =
-        VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    colorBlendState.blendEnable = VK_TRUE;
-    colorBlendState.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-    colorBlendState.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-    colorBlendState.colorBlendOp = VK_BLEND_OP_ADD;
-    colorBlendState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-    colorBlendState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-    colorBlendState.alphaBlendOp = VK_BLEND_OP_ADD;
-
-    VkPipelineColorBlendStateCreateInfo colorBlendStateInfo = {};
-    colorBlendStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    colorBlendStateInfo.logicOpEnable = VK_FALSE;
-    colorBlendStateInfo.logicOp = VK_LOGIC_OP_COPY;
-    colorBlendStateInfo.attachmentCount = 1;
-    colorBlendStateInfo.pAttachments = &colorBlendState;
-    colorBlendStateInfo.blendConstants[0] = 0.0f;
-    colorBlendStateInfo.blendConstants[1] = 0.0f;
-    colorBlendStateInfo.blendConstants[2] = 0.0f;
-    colorBlendStateInfo.blendConstants[3] = 0.0f;
-
-    VkDynamicState dynamicStates[] = {
-        VK_DYNAMIC_STATE_VIEWPORT,
-        VK_DYNAMIC_STATE_LINE_WIDTH
-    };
-
-    VkPipelineDynamicStateCreateInfo dynamicStateInfo = {};
-    dynamicStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-    dynamicStateInfo.dynamicStateCount = 2;
-    dynamicStateInfo.pDynamicStates = dynamicStates;
-
+void Context::createPipelineLayout() {
     VkPushConstantRange pushConstantRange = {};
     pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
     pushConstantRange.offset = 0;
@@ -458,28 +481,6 @@ void Context::createPipeline() {
 
     if (vkCreatePipelineLayout(m_device, &pipelineCreateInfo, nullptr, &m_pipelineLayout) != VK_SUCCESS)
         throw std::runtime_error("Failed to create pipeline layout!");
-
-    VkGraphicsPipelineCreateInfo pipelineInfo = {};
-    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineInfo.stageCount = 2;
-    pipelineInfo.pStages = shaderStages;
-    pipelineInfo.pVertexInputState = &vertexInputInfo;
-    pipelineInfo.pInputAssemblyState = &inputAssemblyInfo;
-    pipelineInfo.pViewportState = &viewportStateInfo;
-    pipelineInfo.pRasterizationState = &rasterizationStateInfo;
-    pipelineInfo.pMultisampleState = &multisampleStateInfo;
-    pipelineInfo.pDepthStencilState = nullptr;
-    pipelineInfo.pColorBlendState = &colorBlendStateInfo;
-    pipelineInfo.pDynamicState = nullptr;
-    pipelineInfo.layout = m_pipelineLayout;
-    pipelineInfo.renderPass = m_renderPass;
-    pipelineInfo.subpass = 0;
-    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-    pipelineInfo.basePipelineIndex = -1;
-
-    if (vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_grahicsPipeline) !=
-        VK_SUCCESS)
-        throw std::runtime_error("Failed to create graphics pipeline!");
 }
 
 void Context::createFramebuffers() {
@@ -487,13 +488,14 @@ void Context::createFramebuffers() {
 
     for (size_t i = 0; i < m_swapChainImageViews.size(); i++) {
         VkImageView attachments[] = {
-            m_swapChainImageViews[i]
+            m_swapChainImageViews[i],
+            m_depthView
         };
 
         VkFramebufferCreateInfo framebufferInfo = {};
         framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
         framebufferInfo.renderPass = m_renderPass;
-        framebufferInfo.attachmentCount = 1;
+        framebufferInfo.attachmentCount = 2;
         framebufferInfo.pAttachments = attachments;
         framebufferInfo.width = m_swapChainExtent.width;
         framebufferInfo.height = m_swapChainExtent.height;
@@ -504,63 +506,16 @@ void Context::createFramebuffers() {
     }
 }
 
-void Context::createCommandPool() {
-    QueueFamilyIndices indices = getQueueFamilyIndices(m_physicalDevice);
-
-    VkCommandPoolCreateInfo poolInfo = {};
-    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    poolInfo.queueFamilyIndex = static_cast<uint32_t>(indices.graphics);
-    poolInfo.flags = 0;
-
-    if (vkCreateCommandPool(m_device, &poolInfo, nullptr, &m_commandPool) != VK_SUCCESS)
-        throw std::runtime_error("Failed to create command pool!");
-}
-
-
-void Context::createVertexBuffer() {
-    createBuffer(m_vertexSize,
-                 VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                 m_vertexBuffer,
-                 m_vertexBufferMem);
-
-    vkMapMemory(m_device, m_vertexBufferMem, 0, m_vertexSize, 0, &m_vertexBufferMappedMem);
-    /*
-    VkBuffer stagingBuffer = {};
-    VkDeviceMemory stagingBufferMem = {};
-    createBuffer(sizeof(verts),
+void Context::createStagingBuffer() {
+    // Persistently mapped, uploads are written straight into it and copied out on the GPU
+    m_stagingBuffer.size = m_stagingSize;
+    createBuffer(m_stagingSize,
                  VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                 stagingBuffer,
-                 stagingBufferMem);
-
-
-    void* data;
-    vkMapMemory(m_device, stagingBufferMem, 0, sizeof(verts), 0, &data);
-    std::memcpy(data, verts, sizeof(verts));
-    vkUnmapMemory(m_device, stagingBufferMem);
-
-    createBuffer(sizeof(verts),
-                 VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                 m_vertexBuffer,
-                 m_vertexBufferMem);
-
-    copyBuffer(stagingBuffer, m_vertexBuffer, sizeof(verts));
-
-    vkDestroyBuffer(m_device, stagingBuffer, nullptr);
-    vkFreeMemory(m_device, stagingBufferMem, nullptr);
-     */
-}
-
-void Context::createIndexBuffer() {
-    createBuffer(m_indexSize,
-                 VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                 m_indexBuffer,
-                 m_indexBufferMem);
-
-    vkMapMemory(m_device, m_indexBufferMem, 0, m_indexSize, 0, &m_indexBufferMappedMem);
+                 m_stagingBuffer.buffer,
+                 m_stagingBuffer.memory,
+                 true);
+    m_stagingRing = vk::StagingRing(m_stagingSize);
 }
 
 void Context::createDescriptorPool() {
@@ -670,13 +625,434 @@ void Context::createUniformBuffer() {
                  m_uniformBufferMem);
 }
 
-void Context::createSemaphores() {
+void Context::createFrames() {
     VkSemaphoreCreateInfo semaphoreInfo = {};
     semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-    if (vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_imageAvailable) != VK_SUCCESS ||
-        vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_renderFinished) != VK_SUCCESS)
-        throw std::runtime_error("Failed to create semaphores!");
+    // Start signaled so the first wait on each slot returns immediately
+    VkFenceCreateInfo fenceInfo = {};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    // Buffers are rerecorded every frame and the whole pool is reset at once
+    VkCommandPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = m_graphicsFamily;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+    VkCommandPoolCreateInfo transferPoolInfo = poolInfo;
+    transferPoolInfo.queueFamilyIndex = m_transferFamily;
+
+    for (auto& frame : m_frames) {
+        if (vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &frame.imageAvailable) != VK_SUCCESS ||
+            vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &frame.renderFinished) != VK_SUCCESS ||
+            vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &frame.uploadFinished) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create semaphores!");
+
+        if (vkCreateFence(m_device, &fenceInfo, nullptr, &frame.inFlight) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create fence!");
+
+        frame.commandPools.resize(recordingThreads());
+        for (auto& pool : frame.commandPools) {
+            if (vkCreateCommandPool(m_device, &poolInfo, nullptr, &pool.pool) != VK_SUCCESS)
+                throw std::runtime_error("Failed to create command pool!");
+            pool.usedPrimary = 0;
+            pool.usedSecondary = 0;
+        }
+
+        // Only ever one transfer submission per frame, so a single buffer is enough
+        if (vkCreateCommandPool(m_device, &transferPoolInfo, nullptr, &frame.transferPool) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create command pool!");
+
+        VkCommandBufferAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = frame.transferPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+        if (vkAllocateCommandBuffers(m_device, &allocInfo, &frame.transferCommandBuffer) != VK_SUCCESS)
+            throw std::runtime_error("Failed to allocate command buffer!");
+
+        frame.commandBuffer = VK_NULL_HANDLE;
+        frame.uploadPending = false;
+        frame.imageIndex = 0;
+        frame.serial = 0;
+        frame.stagingHead = 0;
+    }
+
+    m_imagesInFlight.resize(m_swapChainImages.size(), VK_NULL_HANDLE);
+}
+
+Context::FrameResources& Context::beginFrame() {
+    TRACE_SCOPE("begin frame");
+    auto& frame = m_frames[m_currentFrame];
+    vkWaitForFences(m_device, 1, &frame.inFlight, VK_TRUE, std::numeric_limits<uint64_t>::max());
+
+    if (!m_headless)
+        vkAcquireNextImageKHR(m_device, m_swapChain, std::numeric_limits<uint64_t>::max(), frame.imageAvailable,
+                              VK_NULL_HANDLE, &frame.imageIndex);
+    else
+        frame.imageIndex = m_currentFrame;
+
+    // An older slot may still be rendering to the image we got back
+    auto& imageFence = m_imagesInFlight[frame.imageIndex];
+    if (imageFence != VK_NULL_HANDLE && imageFence != frame.inFlight)
+        vkWaitForFences(m_device, 1, &imageFence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+    imageFence = frame.inFlight;
+
+    vkResetFences(m_device, 1, &frame.inFlight);
+
+    // Staging space and buffers the slot's last frame used can go back
+    m_stagingRing.release(frame.stagingHead);
+    auto retired = std::partition(m_releases.begin(), m_releases.end(), [&](auto& release) {
+        return release.first > frame.serial;
+    });
+    for (auto it = retired; it != m_releases.end(); it++)
+        destroyBuffer(it->second.buffer, it->second.memory);
+    m_releases.erase(retired, m_releases.end());
+
+    m_completedSerial = std::max(m_completedSerial, frame.serial);
+    frame.serial = ++m_frameSerial;
+
+    // The GPU is done with everything this slot recorded, so recycle it all in one go
+    for (auto& pool : frame.commandPools) {
+        vkResetCommandPool(m_device, pool.pool, 0);
+        pool.usedPrimary = 0;
+        pool.usedSecondary = 0;
+    }
+    // Graphics waited on the frame's transfer submission, so it is done too
+    vkResetCommandPool(m_device, frame.transferPool, 0);
+
+    frame.commandBuffer = commandBuffer(frame, 0, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+    return frame;
+}
+
+void Context::endFrame(FrameResources& frame) {
+    TRACE_SCOPE("submit");
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    // Offscreen frames have no image to wait for and nothing to present
+    bool present = !m_headless;
+    VkSemaphore waitSemaphores[2];
+    VkPipelineStageFlags waitStages[2];
+    uint32_t waitCount = 0;
+    if (present) {
+        waitSemaphores[waitCount] = frame.imageAvailable;
+        waitStages[waitCount++] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    }
+    if (frame.uploadPending) {
+        waitSemaphores[waitCount] = frame.uploadFinished;
+        waitStages[waitCount++] = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+    }
+    submitInfo.waitSemaphoreCount = waitCount;
+    submitInfo.pWaitSemaphores = waitSemaphores;
+    submitInfo.pWaitDstStageMask = waitStages;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &frame.commandBuffer;
+    submitInfo.signalSemaphoreCount = present ? 1 : 0;
+    submitInfo.pSignalSemaphores = &frame.renderFinished;
+    if (vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, frame.inFlight) != VK_SUCCESS)
+        throw std::runtime_error("Failed to submit draw command queue!");
+
+    m_lastImage = frame.imageIndex;
+    if (!present) {
+        m_currentFrame = (m_currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+        return;
+    }
+
+    VkPresentInfoKHR presentInfo = {};
+    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    presentInfo.waitSemaphoreCount = 1;
+    presentInfo.pWaitSemaphores = &frame.renderFinished;
+    presentInfo.swapchainCount = 1;
+    presentInfo.pSwapchains = &m_swapChain;
+    presentInfo.pImageIndices = &frame.imageIndex;
+    presentInfo.pResults = nullptr;
+    vkQueuePresentKHR(m_presentQueue, &presentInfo);
+
+    m_currentFrame = (m_currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+}
+
+uint32_t Context::recordingThreads() const {
+    // The main thread plus as many workers as the scheduler spawns by default
+    return std::max(std::thread::hardware_concurrency(), 2u);
+}
+
+VkCommandBuffer Context::commandBuffer(FrameResources& frame, uint32_t thread, VkCommandBufferLevel level) {
+    auto& pool = frame.commandPools[thread];
+    bool primary = level == VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    auto& buffers = primary ? pool.primary : pool.secondary;
+    auto& used = primary ? pool.usedPrimary : pool.usedSecondary;
+
+    if (used == buffers.size()) {
+        VkCommandBufferAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = pool.pool;
+        allocInfo.level = level;
+        allocInfo.commandBufferCount = 1;
+
+        VkCommandBuffer commandBuffer;
+        if (vkAllocateCommandBuffers(m_device, &allocInfo, &commandBuffer) != VK_SUCCESS)
+            throw std::runtime_error("Failed to allocate command buffer!");
+        buffers.push_back(commandBuffer);
+    }
+
+    return buffers[used++];
+}
+
+Context::Buffer Context::createDeviceBuffer(VkDeviceSize size, VkBufferUsageFlags usage, bool concurrent) {
+    Buffer buffer;
+    buffer.size = size;
+    buffer.concurrent = concurrent;
+    createBuffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                 buffer.buffer, buffer.memory, concurrent);
+    return buffer;
+}
+
+Context::Buffer Context::createHostBuffer(VkDeviceSize size, VkBufferUsageFlags usage) {
+    Buffer buffer;
+    buffer.size = size;
+    createBuffer(size, usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 buffer.buffer, buffer.memory);
+    return buffer;
+}
+
+Context::Image Context::createImage(const VkImageCreateInfo& info) {
+    Image image;
+    if (vkCreateImage(m_device, &info, nullptr, &image.image) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create image!");
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_physicalDevice, &properties);
+    auto granularity = properties.limits.bufferImageGranularity;
+
+    // Whole granularity pages on both ends keep optimal tiling clear of neighbouring linear buffers
+    VkMemoryRequirements memReqs = {};
+    vkGetImageMemoryRequirements(m_device, image.image, &memReqs);
+    memReqs.alignment = std::max(memReqs.alignment, granularity);
+    memReqs.size = (memReqs.size + granularity - 1) / granularity * granularity;
+
+    image.memory = m_allocator->allocate(memReqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    vkBindImageMemory(m_device, image.image, image.memory.memory, image.memory.offset);
+    return image;
+}
+
+void Context::destroyImage(Image& image) {
+    if (image.image == VK_NULL_HANDLE)
+        return;
+
+    vkDestroyImage(m_device, image.image, nullptr);
+    m_allocator->free(image.memory);
+    image = {};
+}
+
+void Context::release(Buffer& buffer) {
+    if (buffer.buffer == VK_NULL_HANDLE)
+        return;
+
+    // The frame being recorded, or the last one submitted, is the newest that could use it
+    m_releases.emplace_back(m_frameSerial, buffer);
+    buffer = {};
+}
+
+void Context::upload(const Buffer& dst, VkDeviceSize offset, const void* data, VkDeviceSize size) {
+    if (size == 0)
+        return;
+
+    TRACE_SCOPE("upload");
+    VkDeviceSize stagingOffset;
+    if (m_stagingRing.reserve(size, 16, stagingOffset)) {
+        std::memcpy(static_cast<char*>(m_stagingBuffer.memory.mapped) + stagingOffset, data, size);
+        copyBuffer(m_stagingBuffer.buffer, dst.buffer, {stagingOffset, offset, size});
+        return;
+    }
+
+    // The ring is full or too small, stage through a one off buffer that goes away with the frame
+    Buffer overflow;
+    overflow.size = size;
+    createBuffer(size,
+                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 overflow.buffer,
+                 overflow.memory,
+                 true);
+    std::memcpy(overflow.memory.mapped, data, size);
+    copyBuffer(overflow.buffer, dst.buffer, {0, offset, size});
+    m_releases.emplace_back(m_frameSerial + 1, overflow);
+}
+
+void Context::recordUploads(VkCommandBuffer commandBuffer) {
+    TRACE_SCOPE("record uploads");
+    // Ring space written so far is read by this frame's copies
+    auto& frame = m_frames[m_currentFrame];
+    frame.stagingHead = m_stagingRing.head();
+    frame.uploadPending = false;
+
+    if (!m_pendingTransfers.empty()) {
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(frame.transferCommandBuffer, &beginInfo);
+
+        std::set<VkBuffer> handoff;
+        for (auto& [buffers, regions] : m_pendingTransfers) {
+            vkCmdCopyBuffer(frame.transferCommandBuffer, buffers.first, buffers.second,
+                            static_cast<uint32_t>(regions.size()), regions.data());
+            if (!m_concurrentBuffers.count(buffers.second))
+                handoff.insert(buffers.second);
+        }
+        m_pendingTransfers.clear();
+
+        // Exclusive buffers are released by the transfer family here and acquired by graphics below
+        std::vector<VkBufferMemoryBarrier> release;
+        for (auto buffer : handoff) {
+            VkBufferMemoryBarrier barrier = {};
+            barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = 0;
+            barrier.srcQueueFamilyIndex = m_transferFamily;
+            barrier.dstQueueFamilyIndex = m_graphicsFamily;
+            barrier.buffer = buffer;
+            barrier.offset = 0;
+            barrier.size = VK_WHOLE_SIZE;
+            release.push_back(barrier);
+            m_graphicsOwned.insert(buffer);
+        }
+        if (!release.empty())
+            vkCmdPipelineBarrier(frame.transferCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                 VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr,
+                                 static_cast<uint32_t>(release.size()), release.data(), 0, nullptr);
+        vkEndCommandBuffer(frame.transferCommandBuffer);
+
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &frame.transferCommandBuffer;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &frame.uploadFinished;
+        if (vkQueueSubmit(m_transferQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+            throw std::runtime_error("Failed to submit transfer command queue!");
+        frame.uploadPending = true;
+
+        std::vector<VkBufferMemoryBarrier> acquire = release;
+        for (auto& barrier : acquire) {
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+        }
+        // Source stage matches the semaphore wait so the acquire cannot run ahead of the release
+        if (!acquire.empty())
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                                 VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, nullptr,
+                                 static_cast<uint32_t>(acquire.size()), acquire.data(), 0, nullptr);
+    }
+
+    if (m_pendingUploads.empty())
+        return;
+
+    for (auto& [buffers, regions] : m_pendingUploads)
+        vkCmdCopyBuffer(commandBuffer, buffers.first, buffers.second, static_cast<uint32_t>(regions.size()),
+                        regions.data());
+    m_pendingUploads.clear();
+
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0,
+                         1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void Context::readback(const std::string& path) {
+    if (!m_headless)
+        throw std::runtime_error("Only offscreen frames can be read back!");
+
+    auto image = m_swapChainImages[m_lastImage];
+    auto width = m_swapChainExtent.width;
+    auto height = m_swapChainExtent.height;
+    Buffer pixels = createHostBuffer(static_cast<VkDeviceSize>(width) * height * 4, VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+
+    // Every slot is idle after the wait, so the next one's pool can lend a command buffer until it is reset
+    waitFrames();
+    auto& frame = m_frames[m_currentFrame];
+    VkCommandBuffer commandBuffer = this->commandBuffer(frame, 0, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+    // The render pass already left it in TRANSFER_SRC_OPTIMAL
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    VkBufferImageCopy region = {};
+    region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    region.imageExtent = {width, height, 1};
+    vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, pixels.buffer, 1, &region);
+
+    VkMemoryBarrier hostBarrier = {};
+    hostBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1,
+                         &hostBarrier, 0, nullptr, 0, nullptr);
+    vkEndCommandBuffer(commandBuffer);
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    if (vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+        throw std::runtime_error("Failed to submit readback command queue!");
+    vkQueueWaitIdle(m_graphicsQueue);
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open())
+        throw std::runtime_error("Failed to open file!");
+
+    // Offscreen images are RGBA, PPM is RGB
+    file << "P6\n" << width << " " << height << "\n255\n";
+    auto source = static_cast<const uint8_t*>(pixels.memory.mapped);
+    std::vector<uint8_t> row(static_cast<size_t>(width) * 3);
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            auto pixel = source + (static_cast<size_t>(y) * width + x) * 4;
+            row[x * 3 + 0] = pixel[0];
+            row[x * 3 + 1] = pixel[1];
+            row[x * 3 + 2] = pixel[2];
+        }
+        file.write(reinterpret_cast<const char*>(row.data()), static_cast<std::streamsize>(row.size()));
+    }
+
+    destroyBuffer(pixels.buffer, pixels.memory);
+}
+
+bool Context::headless() const {
+    return m_headless;
+}
+
+uint64_t Context::frameSerial() const {
+    return m_frameSerial;
+}
+
+uint64_t Context::completedSerial() const {
+    return m_completedSerial;
+}
+
+void Context::waitFrames() {
+    std::array<VkFence, MAX_FRAMES_IN_FLIGHT> fences;
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        fences[i] = m_frames[i].inFlight;
+    vkWaitForFences(m_device, MAX_FRAMES_IN_FLIGHT, fences.data(), VK_TRUE, std::numeric_limits<uint64_t>::max());
 }
 
 
@@ -794,15 +1170,28 @@ Context::QueueFamilyIndices Context::getQueueFamilyIndices(VkPhysicalDevice& dev
         if (queueFamilyProps[i].queueCount > 0 && queueFamilyProps[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
             indices.graphics = i;
 
+        // Offscreen frames are never presented, the graphics family stands in
         VkBool32 presentSupport = VK_FALSE;
-        vkGetPhysicalDeviceSurfaceSupportKHR(device, static_cast<uint32_t>(i), m_surface, &presentSupport);
+        if (!m_headless)
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, static_cast<uint32_t>(i), m_surface, &presentSupport);
         if (presentSupport)
             indices.present = i;
+        else if (m_headless && indices.graphics >= 0)
+            indices.present = indices.graphics;
 
         if (indices.complete())
             break;
     }
 
+    // Prefer a family that only does transfers, these map to the GPU's copy engines
+    for (int i = 0; i < queueFamilyProps.size(); i++) {
+        auto flags = queueFamilyProps[i].queueFlags;
+        if (queueFamilyProps[i].queueCount == 0 || !(flags & VK_QUEUE_TRANSFER_BIT) || flags & VK_QUEUE_GRAPHICS_BIT)
+            continue;
+        if (indices.transfer < 0 || !(flags & VK_QUEUE_COMPUTE_BIT))
+            indices.transfer = i;
+    }
+
     return indices;
 }
 
@@ -865,6 +1254,27 @@ VkExtent2D Context::selectSwapExtent(const VkSurfaceCapabilitiesKHR& capabilitie
     }
 }
 
+VkFormat Context::selectDepthFormat() {
+    // D16 is always usable as both, one of the other two is always usable as an attachment
+    const VkFormat candidates[] = {VK_FORMAT_D32_SFLOAT, VK_FORMAT_X8_D24_UNORM_PACK32, VK_FORMAT_D16_UNORM};
+    VkFormat attachmentOnly = VK_FORMAT_UNDEFINED;
+    for (auto format : candidates) {
+        VkFormatProperties properties;
+        vkGetPhysicalDeviceFormatProperties(m_physicalDevice, format, &properties);
+        auto features = properties.optimalTilingFeatures;
+        if (!(features & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT))
+            continue;
+        if (features & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)
+            return format;
+        if (attachmentOnly == VK_FORMAT_UNDEFINED)
+            attachmentOnly = format;
+    }
+
+    if (attachmentOnly == VK_FORMAT_UNDEFINED)
+        throw std::runtime_error("Failed to find a supported depth format!");
+    return attachmentOnly;
+}
+
 bool Context::deviceCompatible(VkPhysicalDevice& device) {
     VkPhysicalDeviceProperties deviceProperties = {};
     vkGetPhysicalDeviceProperties(device, &deviceProperties);
@@ -875,6 +1285,9 @@ bool Context::deviceCompatible(VkPhysicalDevice& device) {
     QueueFamilyIndices indices = getQueueFamilyIndices(device);
 
     bool extensionsSupported = supportsDeviceExtensions(device, m_deviceExtensions);
+    if (m_headless)
+        return indices.complete() && extensionsSupported;
+
     SwapChainSupportInfo swapChainInfo = {};
     if (extensionsSupported) {
         swapChainInfo = getSwapChainSupport(device);
@@ -901,72 +1314,50 @@ int Context::scoreDevice(VkPhysicalDevice& device) {
 }
 
 uint32_t Context::findMemType(uint32_t filter, VkMemoryPropertyFlags flags) {
-    VkPhysicalDeviceMemoryProperties deviceMemoryProperties = {};
-    vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &deviceMemoryProperties);
-
-    for (uint32_t i = 0; i < deviceMemoryProperties.memoryTypeCount; i++)
-        if (filter & (1 << i) && (deviceMemoryProperties.memoryTypes[i].propertyFlags & flags) == flags)
-            return i;
-
-    throw std::runtime_error("Failed to find memory type!");
+    return m_allocator->findMemoryType(filter, flags);
 }
 
 void Context::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags flags, VkBuffer& buffer,
-                           VkDeviceMemory& bufferMemory) {
+                           vk::Allocation& bufferMemory, bool concurrent) {
     VkBufferCreateInfo bufferInfo = {};
     bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     bufferInfo.size = size;
     bufferInfo.usage = usage;
     bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
+    uint32_t queueFamilyIndices[] = {m_graphicsFamily, m_transferFamily};
+    if (concurrent && m_graphicsFamily != m_transferFamily) {
+        bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferInfo.queueFamilyIndexCount = 2;
+        bufferInfo.pQueueFamilyIndices = queueFamilyIndices;
+    }
+
     if (vkCreateBuffer(m_device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
         throw std::runtime_error("Failed to create buffer!");
+    if (concurrent)
+        m_concurrentBuffers.insert(buffer);
 
     VkMemoryRequirements memReqs = {};
     vkGetBufferMemoryRequirements(m_device, buffer, &memReqs);
 
-    VkMemoryAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memReqs.size;
-    allocInfo.memoryTypeIndex = findMemType(memReqs.memoryTypeBits, flags);
-
-    if (vkAllocateMemory(m_device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS)
-        throw std::runtime_error("Failed to allocate vertex buffer!");
-
-    vkBindBufferMemory(m_device, buffer, bufferMemory, 0);
+    bufferMemory = m_allocator->allocate(memReqs, flags);
+    vkBindBufferMemory(m_device, buffer, bufferMemory.memory, bufferMemory.offset);
 }
 
-void Context::copyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size) {
-    VkCommandBufferAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandPool = m_commandPool;
-    allocInfo.commandBufferCount = 1;
-
-    VkCommandBuffer commandBuffer;
-    if (vkAllocateCommandBuffers(m_device, &allocInfo, &commandBuffer) != VK_SUCCESS)
-        throw std::runtime_error("Failed to allocate command buffer!");
-
-    VkCommandBufferBeginInfo beginInfo = {};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-    vkBeginCommandBuffer(commandBuffer, &beginInfo);
-
-    VkBufferCopy copyInfo = {};
-    copyInfo.srcOffset = 0;
-    copyInfo.dstOffset = 0;
-    copyInfo.size = size;
-    vkCmdCopyBuffer(commandBuffer, src, dst, 1, &copyInfo);
-
-    vkEndCommandBuffer(commandBuffer);
-
-    VkSubmitInfo submitInfo = {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
-
-    vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(m_graphicsQueue);
+void Context::destroyBuffer(VkBuffer& buffer, vk::Allocation& bufferMemory) {
+    m_graphicsOwned.erase(buffer);
+    m_concurrentBuffers.erase(buffer);
+    vkDestroyBuffer(m_device, buffer, nullptr);
+    m_allocator->free(bufferMemory);
+    buffer = VK_NULL_HANDLE;
+}
 
-    vkFreeCommandBuffers(m_device, m_commandPool, 1, &commandBuffer);
+void Context::copyBuffer(VkBuffer src, VkBuffer dst, const VkBufferCopy& region) {
+    // Once graphics owns an exclusive buffer, handing it back for every update would cost more than the copy
+    bool transfer = m_transferFamily != m_graphicsFamily &&
+                    (m_concurrentBuffers.count(dst) || !m_graphicsOwned.count(dst));
+    if (transfer)
+        m_pendingTransfers[{src, dst}].push_back(region);
+    else
+        m_pendingUploads[{src, dst}].push_back(region);
 }
@@ -4,10 +4,17 @@
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 
+#include <array>
 #include <vector>
 #include <map>
+#include <memory>
+#include <set>
+#include <string>
 
+#include "Vulkan/Allocator.h"
 #include "Vulkan/Instance.h"
+#include "Vulkan/PipelineCache.h"
+#include "Vulkan/StagingRing.h"
 #include "Vulkan/Surface.h"
 
 class Window;
@@ -15,29 +22,115 @@ class Window;
 class Context {
 public:
     explicit Context(Window& window, bool debug);
+    // Renders into images of the given size when there is no window, with no surface or presentation
+    Context(Window* window, VkExtent2D extent, bool debug);
     ~Context();
 
+    static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 2;
+
+    // Command buffers handed out from one pool, rewound when the pool is reset
+    struct CommandPool {
+        VkCommandPool pool;
+        std::vector<VkCommandBuffer> primary;
+        std::vector<VkCommandBuffer> secondary;
+        size_t usedPrimary;
+        size_t usedSecondary;
+    };
+
+    // Everything one frame in flight owns, reused once its fence signals
+    struct FrameResources {
+        VkSemaphore imageAvailable;
+        VkSemaphore renderFinished;
+        VkFence inFlight;
+        // One pool per recording thread, only ever touched by that thread
+        std::vector<CommandPool> commandPools;
+        VkCommandBuffer commandBuffer;
+        // Uploads for the frame go out on the transfer queue and signal uploadFinished for graphics to wait on
+        VkCommandPool transferPool;
+        VkCommandBuffer transferCommandBuffer;
+        VkSemaphore uploadFinished;
+        bool uploadPending;
+        uint32_t imageIndex;
+        // Frame number last submitted from this slot, and how far the staging ring had been written by then
+        uint64_t serial;
+        uint64_t stagingHead;
+    };
+
+    // A buffer and the memory range backing it
+    struct Buffer {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        vk::Allocation memory;
+        VkDeviceSize size = 0;
+        bool concurrent = false;
+    };
+
+    // An image and the memory range backing it
+    struct Image {
+        VkImage image = VK_NULL_HANDLE;
+        vk::Allocation memory;
+    };
+
+    // Threads that may record into a frame at once, thread 0 being the caller of beginFrame
+    uint32_t recordingThreads() const;
+
+    // Waits for the next frame slot to retire and acquires a swap chain image for it
+    FrameResources& beginFrame();
+    // Submits the slot's command buffer, presents, and moves on to the next slot
+    void endFrame(FrameResources& frame);
+    // Waits for every frame in flight, for updating resources all frames share
+    void waitFrames();
+    // Hands out a command buffer from the frame's pool for the given recording thread
+    VkCommandBuffer commandBuffer(FrameResources& frame, uint32_t thread, VkCommandBufferLevel level);
+
+    // Device local buffer that is filled through upload(). Exclusive buffers are handed from the transfer
+    // queue to graphics after their first upload, concurrent ones are shared by both and suit buffers
+    // that keep being updated while in use.
+    Buffer createDeviceBuffer(VkDeviceSize size, VkBufferUsageFlags usage, bool concurrent = false);
+    // Mapped buffer the CPU writes directly, for data rewritten every frame
+    Buffer createHostBuffer(VkDeviceSize size, VkBufferUsageFlags usage);
+    // Destroys the buffer once no frame in flight can still be reading it
+    void release(Buffer& buffer);
+    // Device local image, padded so it never shares a page with a buffer
+    Image createImage(const VkImageCreateInfo& info);
+    // Destroys right away, the caller makes sure the GPU is done with it
+    void destroyImage(Image& image);
+    // Copies data into the staging ring, the transfer is recorded by the next recordUploads
+    void upload(const Buffer& dst, VkDeviceSize offset, const void* data, VkDeviceSize size);
+    // Records every pending upload as one batched copy per destination, plus a barrier for vertex input
+    void recordUploads(VkCommandBuffer commandBuffer);
+
+    // Copies the last frame submitted into a binary PPM file, waiting for the GPU to finish it. Offscreen only,
+    // swap chain images belong to the presentation engine once presented.
+    void readback(const std::string& path);
+
+    bool headless() const;
+
+    // Serial of the frame being recorded (or last submitted), and of the newest frame the GPU has finished
+    uint64_t frameSerial() const;
+    uint64_t completedSerial() const;
+
 private:
-    void init(Window& window, bool debug);
+    void init(Window* window, VkExtent2D extent, bool debug);
 
     void createInstance(bool debug);
     void createSurface(Window& window);
     void createCallback();
     void selectPhysicalDevice();
     void createLogicalDevice(bool debug);
+    void createPipelineCache();
     void createSwapChain(Window& window);
+    void createOffscreenImages(VkExtent2D extent);
     void createImageViews();
+    void createDepthImage();
     void createRenderPass();
     void createDescriptorSetLayout();
-    void createPipeline();
+    void createPipelineLayout();
     void createFramebuffers();
-    void createCommandPool();
-    void createVertexBuffer();
-    void createIndexBuffer();
+    void createStagingBuffer();
     void createUniformBuffer();
     void createDescriptorPool();
     void createDescriptorSet();
-    void createSemaphores();
+    void createFrames();
 
     static std::vector<VkLayerProperties> getSupportedLayers();
     static std::vector<VkExtensionProperties> getSupportedExtensions();
@@ -50,6 +143,8 @@ private:
     struct QueueFamilyIndices {
         int graphics = -1;
         int present = -1;
+        // Transfer only family, -1 when uploads have to share the graphics queue
+        int transfer = -1;
         inline bool complete() { return graphics >= 0 && present >= 0; }
     };
     std::vector<VkQueueFamilyProperties> getQueueFamilyProperties(VkPhysicalDevice& device);
@@ -69,11 +164,15 @@ private:
     VkSurfaceFormatKHR selectSwapChainSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& formats);
     VkPresentModeKHR selectSwapChainPresentMode(const std::vector<VkPresentModeKHR>& modes);
     VkExtent2D selectSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities, Window& window);
+    // Depth only formats, preferring ones that can also be sampled
+    VkFormat selectDepthFormat();
 
     uint32_t findMemType(uint32_t filter, VkMemoryPropertyFlags flags);
 
-    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags flags, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
-    void copyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size);
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags flags, VkBuffer& buffer, vk::Allocation& bufferMemory, bool concurrent = false);
+    void destroyBuffer(VkBuffer& buffer, vk::Allocation& bufferMemory);
+    // Queues a copy for the next recordUploads, on the transfer queue when the destination allows it
+    void copyBuffer(VkBuffer src, VkBuffer dst, const VkBufferCopy& region);
 
     static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
         VkDebugReportFlagsEXT flags,
@@ -103,46 +202,72 @@ public:
     };
 
     VkDebugReportCallbackEXT m_debugReportCallback;
-    VkSurfaceKHR m_surface;
+    VkSurfaceKHR m_surface = VK_NULL_HANDLE;
     vk::khr::Surface m_vsurface;
 
     vk::Instance m_vinstance;
     VkInstance m_instance;
     VkPhysicalDevice m_physicalDevice = VK_NULL_HANDLE;
     VkDevice m_device;
-
-    VkSwapchainKHR m_swapChain;
+    // Optional features the device was created with
+    VkPhysicalDeviceFeatures m_features = {};
+    // Set when VK_KHR_draw_indirect_count is enabled
+    PFN_vkCmdDrawIndexedIndirectCountKHR m_drawIndexedIndirectCount = nullptr;
+    std::unique_ptr<vk::Allocator> m_allocator;
+    // Every pipeline is created through this, it is saved back to disk on shutdown
+    static constexpr const char* PIPELINE_CACHE_PATH = "pipeline.cache";
+    std::unique_ptr<vk::PipelineCache> m_pipelineCache;
+
+    // Without a window m_swapChainImages are offscreen images, one per frame slot, and there is no swap chain
+    bool m_headless = false;
+    VkSwapchainKHR m_swapChain = VK_NULL_HANDLE;
     std::vector<VkImage> m_swapChainImages;
+    std::vector<Image> m_offscreenImages;
+    // Layout the render pass leaves the images in, for presenting or for reading back
+    VkImageLayout m_finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    uint32_t m_lastImage = 0;
     std::vector<VkImageView> m_swapChainImageViews;
     std::vector<VkFramebuffer> m_swapChainFramebuffers;
     VkFormat m_swapChainFormat;
     VkExtent2D m_swapChainExtent;
 
+    // Shared by every frame, the render pass clears it each time. When it can be sampled it is left in
+    // DEPTH_STENCIL_READ_ONLY_OPTIMAL after the pass, for the occlusion pyramid to be built from.
+    Image m_depthImage;
+    VkImageView m_depthView;
+    VkFormat m_depthFormat;
+    bool m_depthSampled = false;
+
     VkDescriptorSetLayout m_descriptorSetLayout;
-    VkPipeline m_grahicsPipeline;
     VkPipelineLayout m_pipelineLayout;
     VkRenderPass m_renderPass;
 
-    VkCommandPool m_commandPool;
-
-    VkSemaphore m_imageAvailable;
-    VkSemaphore m_renderFinished;
+    std::array<FrameResources, MAX_FRAMES_IN_FLIGHT> m_frames;
+    std::vector<VkFence> m_imagesInFlight;
+    uint32_t m_currentFrame = 0;
 
     VkQueue m_graphicsQueue;
     VkQueue m_presentQueue;
-
-    static constexpr uint32_t m_vertexSize = 10240;
-    VkBuffer m_vertexBuffer;
-    VkDeviceMemory m_vertexBufferMem;
-    void* m_vertexBufferMappedMem;
-
-    static constexpr uint32_t m_indexSize = 10240;
-    VkBuffer m_indexBuffer;
-    VkDeviceMemory m_indexBufferMem;
-    void* m_indexBufferMappedMem;
+    VkQueue m_transferQueue;
+    uint32_t m_graphicsFamily;
+    uint32_t m_transferFamily;
+
+    static constexpr VkDeviceSize m_stagingSize = 8 * 1024 * 1024;
+    Buffer m_stagingBuffer;
+    vk::StagingRing m_stagingRing;
+    // Copies staged since the last recordUploads, grouped by destination
+    std::map<std::pair<VkBuffer, VkBuffer>, std::vector<VkBufferCopy>> m_pendingUploads;
+    std::map<std::pair<VkBuffer, VkBuffer>, std::vector<VkBufferCopy>> m_pendingTransfers;
+    // Exclusive buffers the graphics queue has acquired, and buffers shared between both queues
+    std::set<VkBuffer> m_graphicsOwned;
+    std::set<VkBuffer> m_concurrentBuffers;
+    // Buffers waiting on the frame serial that last used them
+    std::vector<std::pair<uint64_t, Buffer>> m_releases;
+    uint64_t m_frameSerial = 0;
+    uint64_t m_completedSerial = 0;
 
     VkBuffer m_uniformBuffer;
-    VkDeviceMemory m_uniformBufferMem;
+    vk::Allocation m_uniformBufferMem;
 
     VkDescriptorPool m_descriptorPool;
     VkDescriptorSet m_descriptorSet;
@@ -1,11 +1,14 @@
 #include "Engine.h"
 
+#include <algorithm>
 #include <chrono>
+#include <functional>
 #include <thread>
 #include <iostream>
 #include <cstring>
 
 #include "Threads/Scheduler.h"
+#include "Trace/Trace.h"
 
 namespace {
     GLFWwindow* createWindow(const std::string& title, int width, int height) {
@@ -16,22 +19,111 @@ namespace {
     }
 }
 
-Engine::Engine() : scheduler(),
-                   m_window(800, 600, "OpenMiner"),
-                   context(m_window, g_debug) {
+Engine::Engine() : Engine(Options()) {}
+
+Engine::Engine(Options options) : m_options(std::move(options)),
+                                  m_scheduler(),
+                                  m_window(m_options.headless ? nullptr
+                                                              : std::make_unique<Window>(m_options.width,
+                                                                                         m_options.height,
+                                                                                         "OpenMiner")),
+                                  m_context(m_window.get(), {m_options.width, m_options.height}, g_debug),
+                                  m_pipelines(m_context, m_scheduler),
+                                  m_shaders(m_scheduler, "Shaders", SHADER_OUTPUT_PATH) {
 }
 
 Engine::~Engine() {
 }
 
 void Engine::launch() {
-    while (!glfwWindowShouldClose(m_window.window())) {
-        glfwPollEvents();
+    TRACE_THREAD("main");
+    if (!m_options.tracePath.empty())
+        trace::start();
+
+    // Simulation ticks at a fixed rate on its own thread, rendering and input stay on this one
+    std::atomic_bool running = true;
+    std::thread simulation;
+    if (!m_options.lockstep)
+        simulation = std::thread(&Engine::simulate, this, std::cref(running));
+
+    try {
+        uint32_t frames = 0;
+        while ((!m_window || !glfwWindowShouldClose(m_window->window())) &&
+               (m_options.frames == 0 || frames < m_options.frames)) {
+            TRACE_FRAME(frames);
+            TRACE_SCOPE("frame");
+            {
+                TRACE_SCOPE("pacer wait");
+                m_pacer.wait();
+            }
+
+            if (m_window)
+                glfwPollEvents();
+            m_pacer.markInput();
+
+            // Edited shaders compile in the background, their pipelines are swapped in between frames
+            {
+                TRACE_SCOPE("shader reload");
+                for (auto& shader : m_shaders.poll())
+                    m_pipelines.reload(shader);
+                m_pipelines.swap();
+            }
+
+            if (!m_frames.empty()) {
+                if (m_window)
+                    getFrame().input();
+                if (m_options.lockstep) {
+                    TRACE_SCOPE("tick");
+                    getFrame().update(TIMESTEP);
+                }
+                getFrame().render(m_context);
+            }
+            frames++;
+
+            m_pacer.markPresent();
+        }
+    } catch (...) {
+        running = false;
+        if (simulation.joinable())
+            simulation.join();
+        throw;
+    }
+
+    running = false;
+    if (simulation.joinable())
+        simulation.join();
+
+    if (!m_window && !m_options.capturePath.empty())
+        m_context.readback(m_options.capturePath);
+
+    if (!m_options.tracePath.empty()) {
+        trace::stop();
+        trace::write(m_options.tracePath);
+    }
+}
+
+void Engine::simulate(const std::atomic_bool& running) {
+    using clock = std::chrono::steady_clock;
+
+    // Don't try to catch up on more than this after a stall
+    constexpr float maxFrameTime = 0.25f;
+
+    TRACE_THREAD("simulation");
+    auto last = clock::now();
+    float accumulator = 0.0f;
+    while (running) {
+        auto now = clock::now();
+        accumulator += std::min(std::chrono::duration<float>(now - last).count(), maxFrameTime);
+        last = now;
 
-        if (!m_frames.empty()) {
-            getFrame().update(0, context);
-            getFrame().render(context);
+        while (accumulator >= TIMESTEP) {
+            TRACE_SCOPE("tick");
+            if (!m_frames.empty())
+                getFrame().update(TIMESTEP);
+            accumulator -= TIMESTEP;
         }
+
+        std::this_thread::sleep_for(std::chrono::duration<float>(TIMESTEP - accumulator));
     }
 }
 
@@ -47,6 +139,24 @@ Frame& Engine::getFrame() {
 }
 
 Window& Engine::window() {
-    return m_window;
+    if (!m_window)
+        throw std::runtime_error("Headless engines have no window!");
+    return *m_window;
+}
+
+Scheduler& Engine::scheduler() {
+    return m_scheduler;
+}
+
+Context& Engine::context() {
+    return m_context;
+}
+
+FramePacer& Engine::pacer() {
+    return m_pacer;
+}
+
+PipelineRegistry& Engine::pipelines() {
+    return m_pipelines;
 }
 
@@ -1,13 +1,18 @@
 #pragma once
+#include <atomic>
 #include <vector>
 #include <memory>
+#include <string>
 
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
 #include "Frames/Frame.h"
+#include "Render/PipelineRegistry.h"
+#include "Shader/ShaderWatcher.h"
 #include "Threads/Scheduler.h"
 #include "Context.h"
+#include "FramePacer.h"
 #include "Window.h"
 
 #ifdef NDEBUG
@@ -19,7 +24,27 @@ constexpr bool g_debug = true;
 
 class Engine {
 public:
+    // Simulation rate, independent of how fast frames are rendered
+    static constexpr float TIMESTEP = 1.0f / 60.0f;
+
+    struct Options {
+        // Render into offscreen images with no window, input or presentation
+        bool headless = false;
+        uint32_t width = 800;
+        uint32_t height = 600;
+        // Stop after this many frames, 0 runs until the window closes or the process is stopped
+        uint32_t frames = 0;
+        // Headless runs write their last frame here as a PPM, when set
+        std::string capturePath;
+        // Trace the whole run and write it here as Chrome trace JSON, when set
+        std::string tracePath;
+        // Run one simulation tick before each frame on the render thread instead of ticking on the clock,
+        // so a given frame always renders the same world
+        bool lockstep = false;
+    };
+
     Engine();
+    explicit Engine(Options options);
     ~Engine();
 
     void launch();
@@ -50,12 +75,25 @@ public:
     };
     Frame& getFrame();
 
+    // Only when not headless
     Window& window();
+    Scheduler& scheduler();
+    Context& context();
+    FramePacer& pacer();
+    PipelineRegistry& pipelines();
 
 private:
-    Scheduler scheduler;
-    Window m_window;
-    Context context;
+    void simulate(const std::atomic_bool& running);
+
+    Options m_options;
+    Scheduler m_scheduler;
+    std::unique_ptr<Window> m_window;
+    Context m_context;
+    FramePacer m_pacer;
+    PipelineRegistry m_pipelines;
+    // Shaders rebuilt while running are written here rather than over the checked in modules
+    static constexpr const char* SHADER_OUTPUT_PATH = "shader.cache";
+    ShaderWatcher m_shaders;
 
     std::vector<std::unique_ptr<Frame>> m_frames;
 };
@@ -0,0 +1,106 @@
+#include "FramePacer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+namespace {
+    // Weight of the newest sample in the smoothed timings
+    constexpr float smoothing = 0.1f;
+
+    // Frames in low latency mode start this early to absorb variance in frame time
+    constexpr float latencyMargin = 0.001f;
+
+    float seconds(FramePacer::Clock::duration duration) {
+        return std::chrono::duration<float>(duration).count();
+    }
+}
+
+FramePacer::FramePacer(float targetFps) {
+    setTargetFps(targetFps);
+}
+
+void FramePacer::setTargetFps(float fps) {
+    m_targetFps = std::max(fps, 0.0f);
+    m_period = m_targetFps > 0.0f
+               ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(1.0f / m_targetFps))
+               : Clock::duration::zero();
+}
+
+float FramePacer::targetFps() const {
+    return m_targetFps;
+}
+
+void FramePacer::setLowLatency(bool enabled) {
+    m_lowLatency = enabled;
+}
+
+bool FramePacer::lowLatency() const {
+    return m_lowLatency;
+}
+
+void FramePacer::wait() {
+    if (m_period == Clock::duration::zero()) {
+        m_frameStart = Clock::now();
+        return;
+    }
+
+    Clock::time_point deadline;
+    if (m_lowLatency) {
+        // Anchor on the last present and start only as early as the frame is expected to take
+        auto lead = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(m_latency + latencyMargin));
+        deadline = m_lastPresent + m_period - std::min(lead, m_period);
+    } else {
+        deadline = m_frameStart + m_period;
+    }
+
+    auto now = Clock::now();
+    if (deadline > now)
+        preciseSleep(deadline - now);
+
+    // If we fell behind by more than a frame, start over instead of rushing to catch up
+    now = Clock::now();
+    m_frameStart = now - deadline > m_period ? now : deadline;
+}
+
+void FramePacer::markInput() {
+    m_input = Clock::now();
+}
+
+void FramePacer::markPresent() {
+    m_lastPresent = Clock::now();
+
+    float sample = seconds(m_lastPresent - m_input);
+    m_latency += (sample - m_latency) * smoothing;
+}
+
+float FramePacer::latency() const {
+    return m_latency;
+}
+
+void FramePacer::preciseSleep(Clock::duration duration) {
+    // Running estimate of how long a 1 ms OS sleep really takes on this thread
+    static thread_local float estimate = 0.005f;
+    static thread_local float mean = 0.001f;
+    static thread_local float m2 = 0.0f;
+    static thread_local int64_t count = 1;
+
+    auto target = Clock::now() + duration;
+
+    while (seconds(target - Clock::now()) > estimate) {
+        auto start = Clock::now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        float observed = seconds(Clock::now() - start);
+
+        // Welford's online variance, the estimate is the mean plus one standard deviation
+        count++;
+        float delta = observed - mean;
+        mean += delta / count;
+        m2 += delta * (observed - mean);
+        estimate = mean + std::sqrt(m2 / (count - 1));
+    }
+
+    // Spin for the remainder, the OS can't wake us up this precisely
+    while (Clock::now() < target)
+        std::this_thread::yield();
+}
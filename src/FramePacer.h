@@ -0,0 +1,44 @@
+#pragma once
+
+#include <chrono>
+
+// Frame rate limiter. Sleeps with the OS scheduler while it's safe to and spins for the last stretch,
+// so frames start within microseconds of their deadline. In low latency mode the wait is moved to
+// just before input is sampled, so input is read as late as possible for the predicted frame time. That
+// only helps input the frame applies as it renders, input handed to the simulation still waits for a tick.
+class FramePacer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit FramePacer(float targetFps = 0.0f);
+
+    // 0 disables the limiter
+    void setTargetFps(float fps);
+    float targetFps() const;
+
+    void setLowLatency(bool enabled);
+    bool lowLatency() const;
+
+    // Blocks until the next frame should start sampling input
+    void wait();
+
+    void markInput();
+    void markPresent();
+
+    // Smoothed time from sampling input to presenting the frame that rendered it, in seconds. Input that goes
+    // through the simulation shows up to a tick plus the interpolation delay later than this.
+    float latency() const;
+
+    static void preciseSleep(Clock::duration duration);
+
+private:
+    float m_targetFps = 0.0f;
+    Clock::duration m_period{};
+    bool m_lowLatency = false;
+
+    Clock::time_point m_frameStart = Clock::now();
+    Clock::time_point m_lastPresent = Clock::now();
+    Clock::time_point m_input = Clock::now();
+
+    float m_latency = 0.0f;
+};
@@ -9,7 +9,11 @@ public:
     explicit Frame(Engine& engine) : m_engine(engine) {}
     virtual ~Frame() = default;
 
-    virtual void update(float dt, Context& context) = 0;
+    // Samples input on the main thread, for the next render or update to consume
+    virtual void input() = 0;
+    // Advances the simulation by a fixed dt, called from the simulation thread, which never touches Vulkan
+    virtual void update(float dt) = 0;
+    // Draws the most recently published simulation state, called from the main thread
     virtual void render(Context& context) = 0;
 
     virtual void enter() = 0;
@@ -3,221 +3,769 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <algorithm>
 #include <chrono>
 #include <iostream>
 
 #include "../Engine.h"
+#include "../Trace/Trace.h"
+#include "../World/Fluid.h"
+
+TestFrame::TestFrame(Engine& engine) : TestFrame(engine, Options()) {}
+
+TestFrame::TestFrame(Engine& engine, Options options) : Frame(engine), options(options), state(Engine::TIMESTEP),
+                                                        physics(world, &engine.scheduler()),
+                                                        ticker(world, &engine.scheduler()),
+                                                        meshPool(engine.context(), 6 * sizeof(float),
+                                                                 POOL_VERTICES, POOL_INDICES) {
+    auto& context = engine.context();
+    auto& pipelines = engine.pipelines();
+    pendingInput.angles = lookAngles;
+    if (options.gpuCulling && GpuCuller::supported(context)) {
+        culler = std::make_unique<GpuCuller>(context, pipelines);
+        // Occlusion culling needs the depth to build its pyramid from
+        if (context.m_depthSampled)
+            culler->setDepthSource(context.m_depthView);
+    }
+    if (GpuProfiler::supported(context))
+        gpuProfiler = std::make_unique<GpuProfiler>(context);
+
+    PipelineRegistry::Desc opaque;
+    opaque.name = "opaque pipeline";
+    opaque.vertexShader = "Shaders/vert.spv";
+    opaque.fragmentShader = "Shaders/frag.spv";
+    opaque.depthTest = true;
+    opaque.depthWrite = true;
+    // Nothing shows through opaque faces, and without blending the hardware can skip reading the target
+    opaque.blend = false;
+    opaque.layout = context.m_pipelineLayout;
+    opaque.renderPass = context.m_renderPass;
+    opaquePipeline = pipelines.add(opaque);
+
+    // Rarely used, so it only compiles the first time it is switched on
+    wireframePipeline = opaquePipeline;
+    if (context.m_features.fillModeNonSolid) {
+        auto lines = opaque;
+        lines.name = "wireframe pipeline";
+        lines.polygonMode = VK_POLYGON_MODE_LINE;
+        lines.cullMode = VK_CULL_MODE_NONE;
+        wireframePipeline = pipelines.add(lines, true);
+    }
 
-TestFrame::TestFrame(Engine& engine) : Frame(engine) {}
+    // Tested against the opaque depth but leaves it alone, so translucent faces never hide each other
+    auto translucent = opaque;
+    translucent.name = "translucent pipeline";
+    translucent.fragmentShader = "Shaders/translucent.spv";
+    translucent.depthWrite = false;
+    translucent.blend = true;
+    translucentPipeline = pipelines.add(translucent);
 
-void TestFrame::update(float dt, Context& context) {
-    static auto start = std::chrono::steady_clock::now();
-    auto now = std::chrono::steady_clock::now();
-    auto time = std::chrono::duration<float>(now - start).count();
+    pipelines.compile();
+}
 
+TestFrame::~TestFrame() {
+    if (!options.recordPath.empty() && !recordedPath.empty())
+        recordedPath.save(options.recordPath);
+}
+
+void TestFrame::input() {
     auto win = m_engine.window().window();
     if (glfwGetKey(win, GLFW_KEY_ESCAPE))
         glfwSetWindowShouldClose(win, true);
 
-    if (glfwGetKey(win, GLFW_KEY_W))
-        cameraPos += speed * cameraTarget;
-    if (glfwGetKey(win, GLFW_KEY_S))
-        cameraPos -= speed * cameraTarget;
-    if (glfwGetKey(win, GLFW_KEY_D))
-        cameraPos += speed * glm::normalize(glm::cross(cameraTarget, glm::vec3(0.0f, 1.0f, 0.0f)));
-    if (glfwGetKey(win, GLFW_KEY_A))
-        cameraPos -= speed * glm::normalize(glm::cross(cameraTarget, glm::vec3(0.0f, 1.0f, 0.0f)));
-
-    static bool first = true;
-    if (first) {
-        double mx, my;
-        glfwGetCursorPos(win, &mx, &my);
-        lastMouseX = static_cast<float>(mx);
-        lastMouseY = static_cast<float>(my);
-        first = false;
-    }
-
     double mx;
     double my;
     glfwGetCursorPos(win, &mx, &my);
     auto mouseX = static_cast<float>(mx);
     auto mouseY = static_cast<float>(my);
+    if (firstInput) {
+        lastMouseX = mouseX;
+        lastMouseY = mouseY;
+        firstInput = false;
+    }
 
-    cameraAngles.x += (mouseX - lastMouseX) * sens;
-    cameraAngles.y += (lastMouseY - mouseY) * sens;
-
-    if (cameraAngles.x > 360.0f)
-        cameraAngles.x -= 360.0f;
-    if (cameraAngles.x < -360.0f)
-        cameraAngles.x += 360.0f;
-    if (cameraAngles.y < -89.0f)
-        cameraAngles.y = -89.0f;
-    if (cameraAngles.y > 89.0f)
-        cameraAngles.y = 89.0f;
+    bool click = glfwGetMouseButton(win, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+
+    lookAngles.x += (mouseX - lastMouseX) * sens;
+    lookAngles.y += (lastMouseY - mouseY) * sens;
+    if (lookAngles.x > 360.0f)
+        lookAngles.x -= 360.0f;
+    if (lookAngles.x < -360.0f)
+        lookAngles.x += 360.0f;
+    if (lookAngles.y < -89.0f)
+        lookAngles.y = -89.0f;
+    if (lookAngles.y > 89.0f)
+        lookAngles.y = 89.0f;
+
+    bool wireframeKey = glfwGetKey(win, GLFW_KEY_F) == GLFW_PRESS;
+    if (wireframeKey && !lastWireframeKey)
+        wireframe = !wireframe;
+    lastWireframeKey = wireframeKey;
+
+    // T starts a trace and stops it again, writing it out
+    bool traceKey = glfwGetKey(win, GLFW_KEY_T) == GLFW_PRESS;
+    if (traceKey && !lastTraceKey) {
+        if (!trace::enabled()) {
+            trace::start();
+            std::cout << "Tracing" << std::endl;
+        } else {
+            trace::stop();
+            trace::write("trace.json");
+            std::cout << "Trace written to trace.json" << std::endl;
+        }
+    }
+    lastTraceKey = traceKey;
+
+    {
+        std::lock_guard<std::mutex> lock(inputMutex);
+        pendingInput.forward = glfwGetKey(win, GLFW_KEY_W) != 0;
+        pendingInput.back = glfwGetKey(win, GLFW_KEY_S) != 0;
+        pendingInput.right = glfwGetKey(win, GLFW_KEY_D) != 0;
+        pendingInput.left = glfwGetKey(win, GLFW_KEY_A) != 0;
+        // Latch clicks until an update consumes them
+        pendingInput.click |= click && !lastClick;
+        pendingInput.angles = lookAngles;
+    }
 
+    lastClick = click;
     lastMouseX = mouseX;
     lastMouseY = mouseY;
+}
 
-    cameraTarget.x = glm::cos(glm::radians(cameraAngles.y)) * glm::cos(glm::radians(cameraAngles.x));
-    cameraTarget.y = glm::sin(glm::radians(cameraAngles.y));
-    cameraTarget.z = glm::cos(glm::radians(cameraAngles.y)) * glm::sin(glm::radians(cameraAngles.x));
-
-    //std::cout << cameraAngles.x << "," << cameraAngles.y << std::endl;
+void TestFrame::update(float dt) {
+    TRACE_SCOPE("TestFrame::update");
+    Input in;
+    {
+        std::lock_guard<std::mutex> lock(inputMutex);
+        in = pendingInput;
+        pendingInput.click = false;
+    }
 
-    mvp.view = glm::lookAt(cameraPos, cameraPos + cameraTarget, glm::vec3(0.0f, 1.0f, 0.0f));
+    cameraAngles = in.angles;
+    cameraTarget = targetFromAngles(cameraAngles);
+
+    glm::vec3 velocity(0.0f, 0.0f, 0.0f);
+    if (in.forward)
+        velocity += speed * cameraTarget;
+    if (in.back)
+        velocity -= speed * cameraTarget;
+    if (in.right)
+        velocity += speed * glm::normalize(glm::cross(cameraTarget, glm::vec3(0.0f, 1.0f, 0.0f)));
+    if (in.left)
+        velocity -= speed * glm::normalize(glm::cross(cameraTarget, glm::vec3(0.0f, 1.0f, 0.0f)));
+
+    physics.body(player).velocity = velocity;
+    physics.update(dt);
+    cameraPos = physics.body(player).position;
+
+    // Random ticks run in the chunks around the camera
+    auto cameraChunk = World::chunkPos(glm::ivec3(glm::floor(cameraPos)));
+    if (!hasActiveChunks || cameraChunk != activeChunk) {
+        if (hasActiveChunks)
+            setActiveAround(activeChunk, false);
+        setActiveAround(cameraChunk, true);
+        activeChunk = cameraChunk;
+        hasActiveChunks = true;
+    }
 
-    static float aspect = m_engine.window().width() / static_cast<float>(m_engine.window().height());
-    mvp.proj = glm::perspective(glm::radians(45.0f), aspect, 0.1f, 1000.0f);
-    mvp.proj[1][1] *= -1;
+    // Water moving changes the world under the mesh
+    ticker.update(dt);
+    if (ticker.changes() != meshedChanges)
+        mesh();
 
-    std::memcpy(context.m_vertexBufferMappedMem, verts.data(), verts.size() * sizeof(float));
-    std::memcpy(context.m_indexBufferMappedMem, indices.data(), indices.size() * sizeof(uint16_t));
+    if (!options.recordPath.empty()) {
+        recordedPath.add({recordedTime, cameraPos, cameraAngles});
+        recordedTime += dt;
+    }
 
-    float integral;
-    std::modf(time, &integral);
-    if (integral > lastIntegral) {
-        std::cout << 1.0f / (frameTime / frameCount) << " FPS" << std::endl;
-        frameTime = 0.0f;
-        frameCount = 0;
-        lastIntegral = integral;
+    // Pick the block under the crosshair, left click breaks it
+    picked = raycast(world, cameraPos, cameraTarget, reach);
+    if (in.click && picked.hit) {
+        world.setBlock(picked.block, AIR);
+        ticker.notify(picked.block);
+        mesh();
     }
+
+    auto& next = state.back();
+    next.cameraPos = cameraPos;
+    next.mesh = currentMesh;
+    state.publish();
 }
 
 void TestFrame::render(Context& context) {
+    TRACE_SCOPE("TestFrame::render");
+    static auto launch = std::chrono::steady_clock::now();
     auto start = std::chrono::steady_clock::now();
+    auto time = std::chrono::duration<float>(start - launch).count();
+
+    State previous;
+    State current;
+    float alpha = state.read(previous, current);
+    if (!current.mesh)
+        return;
+
+    auto eye = glm::mix(previous.cameraPos, current.cameraPos, alpha);
+    // Position comes through the simulation, looking around doesn't wait for it
+    auto direction = targetFromAngles(lookAngles);
+    if (options.cameraPath) {
+        // Timed by frames rendered rather than the clock, so every run sees the same views
+        auto pose = options.cameraPath->sample(static_cast<float>(renderedFrames) * Engine::TIMESTEP);
+        eye = pose.position;
+        direction = pose.direction;
+    }
+    mvp.view = glm::lookAt(eye, eye + direction, glm::vec3(0.0f, 1.0f, 0.0f));
+
+    // The render target's size, there is no window when rendering headless
+    static float aspect = context.m_swapChainExtent.width / static_cast<float>(context.m_swapChainExtent.height);
+    mvp.proj = glm::perspective(glm::radians(45.0f), aspect, 0.1f, 1000.0f);
+    mvp.proj[1][1] *= -1;
+
+    // Frames in flight keep drawing the old mesh, its pool space is only reused once those retire
+    if (current.mesh != uploadedMesh) {
+        if (uploadedMesh)
+            meshPool.remove(pooledMesh);
+        pooledMesh = meshPool.add(current.mesh->verts.data(), static_cast<uint32_t>(current.mesh->verts.size() / 6),
+                                  current.mesh->indices.data(), static_cast<uint32_t>(current.mesh->indices.size()));
+        uploadedMesh = current.mesh;
+
+        // Synthetic copies are laid out on a grid next to the real ones
+        auto& draws = current.mesh->draws;
+        size_t count = options.syntheticDraws > 0 && !draws.empty() ? options.syntheticDraws : draws.size();
+        drawList.resize(count);
+        drawFaces.resize(count);
+        drawBounds.clear();
+        for (size_t i = 0; i < count; i++) {
+            auto& draw = draws[i % draws.size()];
+            auto copy = static_cast<int>(i / draws.size());
+            glm::vec3 offset(COPY_SPACING * (copy % 64), 0.0f, COPY_SPACING * (copy / 64));
+            drawList[i] = {pooledMesh, draw.firstIndex, draw.indexCount, draw.vertexOffset, draw.origin + offset,
+                           draw.boundsMin, draw.boundsMax};
+            drawFaces[i] = draw.faceCounts;
+            drawBounds.add(static_cast<uint32_t>(i), drawList[i].origin + draw.boundsMin,
+                           drawList[i].origin + draw.boundsMax);
+        }
+        drawOrder.resize(count);
+        for (size_t i = 0; i < count; i++)
+            drawOrder[i] = static_cast<uint32_t>(i);
+
+        // Every copy of the mesh brings its translucent cubes along
+        auto& translucent = current.mesh->translucentDraws;
+        size_t copies = draws.empty() ? 1 : (count + draws.size() - 1) / draws.size();
+        size_t translucentCount = copies * translucent.size();
+        translucentList.resize(translucentCount);
+        translucentFaces.resize(translucentCount);
+        translucentBounds.clear();
+        for (size_t i = 0; i < translucentCount; i++) {
+            auto& draw = translucent[i % translucent.size()];
+            auto copy = static_cast<int>(i / translucent.size());
+            glm::vec3 offset(COPY_SPACING * (copy % 64), 0.0f, COPY_SPACING * (copy / 64));
+            translucentList[i] = {pooledMesh, draw.firstIndex, draw.indexCount, draw.vertexOffset,
+                                  draw.origin + offset, draw.boundsMin, draw.boundsMax};
+            translucentFaces[i] = draw.faceCounts;
+            translucentBounds.add(static_cast<uint32_t>(i), translucentList[i].origin + draw.boundsMin,
+                                  translucentList[i].origin + draw.boundsMax);
+        }
+        translucentOrder.resize(translucentCount);
+        for (size_t i = 0; i < translucentCount; i++)
+            translucentOrder[i] = static_cast<uint32_t>(i);
+        translucentVisible.assign(translucentCount, 0);
+        translucentSorted = false;
+    }
+
+    // Wait for this slot's previous frame and acquire an image
+    auto& frame = context.beginFrame();
+    VkCommandBuffer commandBuffer = frame.commandBuffer;
+    frameDraws.clear();
+    frameTriangles = 0;
+    {
+        TRACE_SCOPE("prepare draws");
+        if (culler) {
+            // Compaction keeps roughly the order draws are handed over in
+            if (options.depthSorting)
+                sortFrontToBack(drawOrder, eye);
+            for (auto id : drawOrder)
+                addFaceDraws(drawList[id], drawFaces[id], eye);
+        } else {
+            // The GPU path culls in its compute pass, this one before writing the draws
+            visibleIds.clear();
+            drawBounds.cull(Frustum(mvp.proj * mvp.view), visibleIds);
+            if (options.depthSorting)
+                sortFrontToBack(visibleIds, eye);
+            for (auto id : visibleIds)
+                addFaceDraws(drawList[id], drawFaces[id], eye);
+        }
+        opaqueDrawCount = static_cast<uint32_t>(frameDraws.size());
+
+        // Blending needs the furthest faces drawn first. The order is kept across frames and culling only
+        // picks from it, so most frames cost a frustum test and nothing more.
+        if (!translucentList.empty()) {
+            sortBackToFront(eye);
+            translucentIds.clear();
+            translucentBounds.cull(Frustum(mvp.proj * mvp.view), translucentIds);
+            for (auto id : translucentIds)
+                translucentVisible[id] = 1;
+            for (auto id : translucentOrder) {
+                if (translucentVisible[id])
+                    addFaceDraws(translucentList[id], translucentFaces[id], eye);
+            }
+            for (auto id : translucentIds)
+                translucentVisible[id] = 0;
+        }
+        meshPool.prepare(frameDraws);
+    }
+    framePipeline = m_engine.pipelines().get(wireframe ? wireframePipeline : opaquePipeline, opaquePipeline);
+    frameTranslucentPipeline = wireframe ? framePipeline : m_engine.pipelines().get(translucentPipeline);
 
-    // Acquire Image
-    vkQueueWaitIdle(context.m_presentQueue);
-    uint32_t imageIndex;
-    vkAcquireNextImageKHR(context.m_device, context.m_swapChain, std::numeric_limits<uint64_t>::max(),
-                          context.m_imageAvailable, VK_NULL_HANDLE,
-                          &imageIndex);
-
-    // Allocate command buffer
-    VkCommandBuffer commandBuffer = {};
-    VkCommandBufferAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.commandPool = context.m_commandPool;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandBufferCount = 1;
-    vkAllocateCommandBuffers(context.m_device, &allocInfo, &commandBuffer);
     VkCommandBufferBeginInfo beginInfo = {};
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
     beginInfo.pInheritanceInfo = nullptr;
 
     // Record command buffer
+    auto recordStart = std::chrono::steady_clock::now();
     vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    if (gpuProfiler) {
+        gpuProfiler->beginFrame(commandBuffer);
+        gpuProfiler->begin(commandBuffer, "uploads");
+    }
+    context.recordUploads(commandBuffer);
+    if (gpuProfiler)
+        gpuProfiler->end(commandBuffer);
+    if (culler) {
+        if (gpuProfiler)
+            gpuProfiler->begin(commandBuffer, "cull");
+        culler->cull(commandBuffer, meshPool, mvp.proj * mvp.view * mvp.model, opaqueDrawCount);
+        if (gpuProfiler)
+            gpuProfiler->end(commandBuffer);
+    }
     VkRenderPassBeginInfo renderPassInfo = {};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
     renderPassInfo.renderPass = context.m_renderPass;
-    renderPassInfo.framebuffer = context.m_swapChainFramebuffers[imageIndex];
+    renderPassInfo.framebuffer = context.m_swapChainFramebuffers[frame.imageIndex];
     renderPassInfo.renderArea.offset = {0, 0};
     renderPassInfo.renderArea.extent = context.m_swapChainExtent;
-    VkClearValue clearColor = {0.0f, 0.0f, 0.0f, 1.0f};
-    renderPassInfo.clearValueCount = 1;
-    renderPassInfo.pClearValues = &clearColor;
-    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, context.m_grahicsPipeline);
-    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, context.m_pipelineLayout, 0, 1,
-                            &context.m_descriptorSet, 0, nullptr);
-    VkDeviceSize offset = 0;
-    vkCmdPushConstants(commandBuffer, context.m_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, 48 * sizeof(float),
-                       &mvp);
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &context.m_vertexBuffer, &offset);
-    vkCmdBindIndexBuffer(commandBuffer, context.m_indexBuffer, 0, VK_INDEX_TYPE_UINT16);
-    vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+    std::array<VkClearValue, 2> clearValues = {};
+    clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+    clearValues[1].depthStencil = {1.0f, 0};
+    renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+    renderPassInfo.pClearValues = clearValues.data();
+    // Secondary command buffers can only execute inside the fragment count when they inherit it, without
+    // that the count is skipped and overdraw is unknown
+    bool parallel = !culler && options.parallelRecording && opaqueDrawCount >= 2 * MIN_DRAWS_PER_SLICE;
+    bool countFragments = !parallel || context.m_features.inheritedQueries;
+    if (gpuProfiler) {
+        gpuProfiler->begin(commandBuffer, "main pass");
+        if (countFragments)
+            gpuProfiler->beginFragments(commandBuffer);
+    }
+    if (culler) {
+        // One indirect draw covers the whole list, there is nothing to spread over threads
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        bindPipeline(commandBuffer, context, framePipeline);
+        culler->draw(commandBuffer, meshPool);
+        recordTranslucent(commandBuffer, context);
+    } else if (parallel) {
+        recordParallel(commandBuffer, context, frame, renderPassInfo);
+    } else {
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        record(commandBuffer, context, framePipeline, 0, opaqueDrawCount);
+        recordTranslucent(commandBuffer, context);
+    }
     vkCmdEndRenderPass(commandBuffer);
+    if (gpuProfiler) {
+        if (countFragments)
+            gpuProfiler->endFragments(commandBuffer);
+        gpuProfiler->end(commandBuffer);
+    }
+    if (culler) {
+        // Next frame's occlusion test runs against this frame's depth
+        if (gpuProfiler)
+            gpuProfiler->begin(commandBuffer, "depth pyramid");
+        culler->buildPyramid(commandBuffer, mvp.proj * mvp.view * mvp.model);
+        if (gpuProfiler)
+            gpuProfiler->end(commandBuffer);
+    }
+    if (gpuProfiler)
+        gpuProfiler->endFrame(commandBuffer);
     vkEndCommandBuffer(commandBuffer);
+    recordTime += std::chrono::duration<float>(std::chrono::steady_clock::now() - recordStart).count();
 
-    // Submit command buffer
-    VkSubmitInfo submitInfo = {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    VkSemaphore waitSemaphores[] = {context.m_imageAvailable};
-    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = waitSemaphores;
-    submitInfo.pWaitDstStageMask = waitStages;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
-    VkSemaphore signalSemaphores[] = {context.m_renderFinished};
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = signalSemaphores;
-    if (vkQueueSubmit(context.m_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
-        throw std::runtime_error("Failed to submit draw command queue!");
-
-    // Present
-    VkPresentInfoKHR presentInfo = {};
-    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-    presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = signalSemaphores;
-    presentInfo.swapchainCount = 1;
-    VkSwapchainKHR swapChains[] = {context.m_swapChain};
-    presentInfo.pSwapchains = swapChains;
-    presentInfo.pImageIndices = &imageIndex;
-    presentInfo.pResults = nullptr;
-    vkQueuePresentKHR(context.m_presentQueue, &presentInfo);
-
-    // Wait for idle and clean up
-    vkDeviceWaitIdle(context.m_device);
-    vkFreeCommandBuffers(context.m_device, context.m_commandPool, 1, &commandBuffer);
+    // Submit and present, the GPU works on this frame while we record the next one
+    context.endFrame(frame);
 
     auto end = std::chrono::steady_clock::now();
     frameTime += std::chrono::duration<float>(end - start).count();
     frameCount++;
+    renderedFrames++;
+
+    float gpuMs = gpuProfiler ? gpuProfiler->frameMs() : -1.0f;
+    // Fragments shaded per pixel of the target, 1 would be no overdraw at all on a full screen
+    float overdraw = -1.0f;
+    if (gpuProfiler && gpuProfiler->fragments() >= 0)
+        overdraw = static_cast<float>(gpuProfiler->fragments()) /
+                   static_cast<float>(context.m_swapChainExtent.width * context.m_swapChainExtent.height);
+    if (options.benchmark) {
+        options.benchmark->add({std::chrono::duration<float, std::milli>(end - start).count(), gpuMs,
+                                static_cast<uint32_t>(frameDraws.size()), frameTriangles, overdraw});
+        options.benchmark->addMemory(context.m_allocator->stats());
+        if (gpuProfiler && gpuMs >= 0.0f) {
+            for (auto& scope : gpuProfiler->scopes())
+                options.benchmark->addGpuScope(scope.name, scope.ms);
+        }
+    }
+
+    float integral;
+    std::modf(time, &integral);
+    if (integral > lastIntegral) {
+        std::cout << 1.0f / (frameTime / frameCount) << " FPS, "
+                  << m_engine.pacer().latency() * 1000.0f << " ms look input to present, "
+                  << recordTime / frameCount * 1000.0f << " ms recording " << drawList.size() << " chunks, "
+                  << frameDraws.size() << " draws of " << frameTriangles << " triangles, "
+                  << (culler ? culler->visibleCount() : visibleIds.size()) << " visible";
+        // The GPU's numbers are from a frame that finished, a couple behind the CPU's
+        if (gpuProfiler && gpuMs >= 0.0f) {
+            std::cout << ", " << gpuMs << " ms GPU (";
+            auto& scopes = gpuProfiler->scopes();
+            for (size_t i = 0; i < scopes.size(); i++)
+                std::cout << (i > 0 ? ", " : "") << scopes[i].name << " " << scopes[i].ms << " ms";
+            std::cout << ")";
+        }
+        if (overdraw >= 0.0f)
+            std::cout << ", " << overdraw << "x overdraw";
+        std::cout << std::endl;
+        frameTime = 0.0f;
+        recordTime = 0.0f;
+        frameCount = 0;
+        lastIntegral = integral;
+    }
+}
+
+void TestFrame::sortFrontToBack(std::vector<uint32_t>& ids, const glm::vec3& eye) {
+    // Distances once per draw rather than once per comparison
+    sortKeys.resize(ids.size());
+    for (size_t i = 0; i < ids.size(); i++) {
+        auto& draw = drawList[ids[i]];
+        auto closest = glm::clamp(eye, draw.origin + draw.boundsMin, draw.origin + draw.boundsMax);
+        auto offset = closest - eye;
+        sortKeys[i] = {glm::dot(offset, offset), ids[i]};
+    }
+    std::sort(sortKeys.begin(), sortKeys.end());
+    for (size_t i = 0; i < ids.size(); i++)
+        ids[i] = sortKeys[i].second;
+}
+
+void TestFrame::sortBackToFront(const glm::vec3& eye) {
+    // Inside one chunk the order barely changes, so it is only revisited once the eye leaves it
+    glm::ivec3 chunk(glm::floor(eye / static_cast<float>(Chunk::SIZE)));
+    if (translucentSorted && chunk == sortedChunk)
+        return;
+
+    sortKeys.resize(translucentOrder.size());
+    for (size_t i = 0; i < translucentOrder.size(); i++) {
+        auto& draw = translucentList[translucentOrder[i]];
+        auto offset = draw.origin + (draw.boundsMin + draw.boundsMax) * 0.5f - eye;
+        sortKeys[i] = {-glm::dot(offset, offset), translucentOrder[i]};
+    }
+    if (!translucentSorted) {
+        std::sort(sortKeys.begin(), sortKeys.end());
+    } else {
+        // Moving one chunk only swaps a few neighbours, which insertion sort fixes in about linear time
+        for (size_t i = 1; i < sortKeys.size(); i++) {
+            auto key = sortKeys[i];
+            size_t j = i;
+            for (; j > 0 && key < sortKeys[j - 1]; j--)
+                sortKeys[j] = sortKeys[j - 1];
+            sortKeys[j] = key;
+        }
+    }
+    for (size_t i = 0; i < translucentOrder.size(); i++)
+        translucentOrder[i] = sortKeys[i].second;
+
+    sortedChunk = chunk;
+    translucentSorted = true;
+}
+
+void TestFrame::addFaceDraws(const MeshPool::Draw& draw, const std::array<uint32_t, 6>& faceCounts,
+                             const glm::vec3& eye) {
+    if (!options.faceSplitting) {
+        frameDraws.push_back(draw);
+        frameTriangles += draw.indexCount / 3;
+        return;
+    }
+
+    // A face can only be seen from the side its normal points to, so a direction drops out once the eye
+    // is behind the plane of every face the chunk has in it
+    auto min = draw.origin + draw.boundsMin;
+    auto max = draw.origin + draw.boundsMax;
+    std::array<bool, 6> visible{};
+    visible[SOUTH] = eye.z > min.z;
+    visible[NORTH] = eye.z < max.z;
+    visible[EAST] = eye.x > min.x;
+    visible[WEST] = eye.x < max.x;
+    visible[TOP] = eye.y > min.y;
+    visible[BOTTOM] = eye.y < max.y;
+
+    // Neighbouring visible groups are contiguous, so they share one draw
+    uint32_t offset = 0;
+    for (int face = 0; face < 6;) {
+        if (!visible[face] || faceCounts[face] == 0) {
+            offset += faceCounts[face++];
+            continue;
+        }
+
+        auto split = draw;
+        split.firstIndex = draw.firstIndex + offset;
+        split.indexCount = 0;
+        for (; face < 6 && visible[face]; face++)
+            split.indexCount += faceCounts[face];
+        offset += split.indexCount;
+        frameDraws.push_back(split);
+        frameTriangles += split.indexCount / 3;
+    }
+}
+
+void TestFrame::bindPipeline(VkCommandBuffer commandBuffer, Context& context, VkPipeline pipeline) const {
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, context.m_pipelineLayout, 0, 1,
+                            &context.m_descriptorSet, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, context.m_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, 48 * sizeof(float),
+                       &mvp);
+}
+
+void TestFrame::record(VkCommandBuffer commandBuffer, Context& context, VkPipeline pipeline, uint32_t first,
+                       uint32_t count) const {
+    bindPipeline(commandBuffer, context, pipeline);
+    meshPool.record(commandBuffer, first, count);
+}
+
+void TestFrame::recordTranslucent(VkCommandBuffer commandBuffer, Context& context) const {
+    auto count = static_cast<uint32_t>(frameDraws.size()) - opaqueDrawCount;
+    if (count > 0)
+        record(commandBuffer, context, frameTranslucentPipeline, opaqueDrawCount, count);
+}
+
+void TestFrame::recordParallel(VkCommandBuffer primary, Context& context, Context::FrameResources& frame,
+                               VkRenderPassBeginInfo& renderPassInfo) {
+    // Thread 0 is recording the primary buffer, so slices use the pools after it
+    // Slices only split the opaque draws, the translucent ones have to stay in order after all of them
+    size_t slices = std::min<size_t>(context.recordingThreads() - 1, opaqueDrawCount / MIN_DRAWS_PER_SLICE);
+    size_t perSlice = (opaqueDrawCount + slices - 1) / slices;
+
+    VkCommandBufferInheritanceInfo inheritanceInfo = {};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = renderPassInfo.renderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = renderPassInfo.framebuffer;
+    if (gpuProfiler && context.m_features.inheritedQueries)
+        inheritanceInfo.pipelineStatistics = gpuProfiler->inheritedStatistics();
+
+    std::vector<VkCommandBuffer> secondaries(slices);
+    std::vector<Scheduler::Future<void>> futures;
+    for (size_t i = 0; i < slices; i++) {
+        futures.push_back(m_engine.scheduler().run([&, i]() {
+            auto thread = static_cast<uint32_t>(i + 1);
+            VkCommandBuffer commandBuffer = context.commandBuffer(frame, thread, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+
+            VkCommandBufferBeginInfo beginInfo = {};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+                              VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+            beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+            TRACE_SCOPE("record slice");
+            size_t first = i * perSlice;
+            size_t last = std::min<size_t>(first + perSlice, opaqueDrawCount);
+            vkBeginCommandBuffer(commandBuffer, &beginInfo);
+            record(commandBuffer, context, framePipeline, static_cast<uint32_t>(first),
+                   static_cast<uint32_t>(last - first));
+            vkEndCommandBuffer(commandBuffer);
+            secondaries[i] = commandBuffer;
+        }));
+    }
+    // This thread records the translucent draws while the workers are busy. The workers write into
+    // secondaries, so it is only appended to once they are done.
+    VkCommandBuffer translucent = VK_NULL_HANDLE;
+    if (opaqueDrawCount < frameDraws.size()) {
+        VkCommandBuffer commandBuffer = context.commandBuffer(frame, 0, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+                          VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+        recordTranslucent(commandBuffer, context);
+        vkEndCommandBuffer(commandBuffer);
+        translucent = commandBuffer;
+    }
+    for (auto& future : futures)
+        future.get();
+    if (translucent != VK_NULL_HANDLE)
+        secondaries.push_back(translucent);
+
+    vkCmdBeginRenderPass(primary, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+    vkCmdExecuteCommands(primary, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+}
+
+void TestFrame::setActiveAround(const glm::ivec3& chunkPos, bool active) {
+    for (int x = -ACTIVE_RADIUS; x <= ACTIVE_RADIUS; x++)
+        for (int y = -ACTIVE_RADIUS; y <= ACTIVE_RADIUS; y++)
+            for (int z = -ACTIVE_RADIUS; z <= ACTIVE_RADIUS; z++)
+                ticker.setActive(chunkPos + glm::ivec3(x, y, z), active);
+}
+
+glm::vec3 TestFrame::targetFromAngles(const glm::vec2& angles) {
+    return {glm::cos(glm::radians(angles.y)) * glm::cos(glm::radians(angles.x)),
+            glm::sin(glm::radians(angles.y)),
+            glm::cos(glm::radians(angles.y)) * glm::sin(glm::radians(angles.x))};
 }
 
 void TestFrame::gen() {
     for (int i = 0; i < 3; i++) {
         for (int j = 0; j < 3; j++) {
             for (int k = 0; k < 3; k++) {
+                BlockId type = 3;
                 if (i > 3 / 2 && i < 3 * 0.75 &&
                     j > 3 / 2 && j < 3 * 0.75 &&
                     k > 3 / 2 && k < 3 * 0.75) {
-                    voxels[i][j][k] = {false, 1, 0};
+                    type = 1;
                 } else if (i == 0) {
-                    voxels[i][j][k] = {false, 2, 0};
-                } else {
-                    voxels[i][j][k] = {false, 3, 0};
+                    type = 2;
                 }
+                world.setBlock({i - 1, j - 1, k - 1}, type);
             }
         }
     }
+
+    // A floor for the water running off the cube to spread over, wide enough that it dries up before the edge
+    for (int x = -WORLD_RADIUS; x <= WORLD_RADIUS; x++)
+        for (int z = -WORLD_RADIUS; z <= WORLD_RADIUS; z++)
+            world.setBlock({x, WORLD_BOTTOM, z}, 2);
+
+    glm::ivec3 source(0, WORLD_TOP, 0);
+    world.setBlock(source, Fluid::WATER_SOURCE);
+    ticker.schedule(source, 1);
 }
 
 void TestFrame::mesh() {
-    for (int i = 0; i < 3; i++) {
-        for (int j = 0; j < 3; j++) {
-            for (int k = 0; k < 3; k++) {
-                if (!voxels[i][j][k].transparent) {
-                    auto newCube = cubeVerts;
-                    for (int l = 0; l < 8; l++) {
-                        newCube[6 * l + 0] += i;
-                        newCube[6 * l + 1] += j;
-                        newCube[6 * l + 2] += k;
+    TRACE_SCOPE("mesh");
+    auto newMesh = std::make_shared<Mesh>();
+    auto& verts = newMesh->verts;
+    auto& indices = newMesh->indices;
+
+    static const std::array<glm::ivec3, 6> normals = {{
+        {0, 0, 1}, {0, 0, -1}, {1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}
+    }};
+    std::array<std::vector<uint16_t>, 6> faces;
+
+    auto first = World::chunkPos({-WORLD_RADIUS, WORLD_BOTTOM, -WORLD_RADIUS});
+    auto last = World::chunkPos({WORLD_RADIUS, WORLD_TOP, WORLD_RADIUS});
+    for (int cx = first.x; cx <= last.x; cx++) {
+        for (int cy = first.y; cy <= last.y; cy++) {
+            for (int cz = first.z; cz <= last.z; cz++) {
+                const Chunk* chunk = world.getChunk({cx, cy, cz});
+                if (!chunk || chunk->empty())
+                    continue;
+                glm::ivec3 chunkCorner = glm::ivec3(cx, cy, cz) * Chunk::SIZE;
+
+                // Water and solid blocks go to separate draws, since water is blended in its own pass
+                for (bool water : {false, true}) {
+                    for (auto& face : faces)
+                        face.clear();
+                    auto firstVertex = verts.size() / 6;
+                    glm::ivec3 min(Chunk::SIZE);
+                    glm::ivec3 max(-1);
+
+                    for (int y = 0; y < Chunk::SIZE; y++) {
+                        for (int z = 0; z < Chunk::SIZE; z++) {
+                            for (int x = 0; x < Chunk::SIZE; x++) {
+                                BlockId block = chunk->get(x, y, z);
+                                if (block == AIR || Fluid::isWater(block) != water)
+                                    continue;
+
+                                glm::ivec3 local(x, y, z);
+                                for (int face = 0; face < 6; face++) {
+                                    // Solid faces show through water, water only shows against air
+                                    auto n = local + normals[face];
+                                    bool inside = World::localPos(n) == n;
+                                    BlockId neighbour = inside ? chunk->get(n.x, n.y, n.z)
+                                                               : world.getBlock(chunkCorner + n);
+                                    if (water ? neighbour != AIR : isSolid(neighbour))
+                                        continue;
+
+                                    // The face's corners, taken from the cube's first triangle and the
+                                    // second's middle vertex
+                                    auto base = static_cast<uint16_t>(verts.size() / 6 - firstVertex);
+                                    for (int corner : {0, 1, 2, 4}) {
+                                        auto vertex = cubeIndices[face * 6 + corner] * 6;
+                                        verts.push_back(cubeVerts[vertex] + x);
+                                        verts.push_back(cubeVerts[vertex + 1] + y);
+                                        verts.push_back(cubeVerts[vertex + 2] + z);
+                                        verts.insert(verts.end(), cubeVerts.begin() + vertex + 3,
+                                                     cubeVerts.begin() + vertex + 6);
+                                    }
+                                    uint16_t quad[] = {0, 1, 2, 2, 3, 0};
+                                    for (auto index : quad)
+                                        faces[face].push_back(static_cast<uint16_t>(base + index));
+                                    min = glm::min(min, local);
+                                    max = glm::max(max, local);
+                                }
+                            }
+                        }
                     }
-
-                    auto newInds = cubeIndices;
-                        for (auto& index : cubeIndices)
-                            index += 8;
-
-                    verts.insert(verts.end(), newCube.begin(), newCube.end());
-                    indices.insert(indices.end(), newInds.begin(), newInds.end());
+                    if (verts.size() / 6 == firstVertex)
+                        continue;
+
+                    // Cubes stay in chunk space, the draw's origin places them. A cube is meshed over
+                    // [origin - 1, origin], so the origin sits one up from the chunk's corner block.
+                    Draw draw;
+                    draw.firstIndex = static_cast<uint32_t>(indices.size());
+                    draw.vertexOffset = static_cast<int32_t>(firstVertex);
+                    draw.origin = glm::vec3(chunkCorner + 1);
+                    draw.boundsMin = glm::vec3(min) - 1.0f;
+                    draw.boundsMax = glm::vec3(max);
+                    for (int face = 0; face < 6; face++) {
+                        draw.faceCounts[face] = static_cast<uint32_t>(faces[face].size());
+                        indices.insert(indices.end(), faces[face].begin(), faces[face].end());
+                    }
+                    draw.indexCount = static_cast<uint32_t>(indices.size()) - draw.firstIndex;
+                    auto& draws = water ? newMesh->translucentDraws : newMesh->draws;
+                    draws.push_back(draw);
                 }
             }
         }
     }
+
+    meshedChanges = ticker.changes();
+    currentMesh = std::move(newMesh);
 }
 
 void TestFrame::enter() {
     //glfwSetInputMode(m_engine.window().window(), GLFW_CURSOR, GLFW_CURSOR_DISABLED);
     static bool hasInitialized = false;
     if (!hasInitialized) {
-        // Generate voxels
+        // Generate the world
         gen();
 
         // Generate mesh
         mesh();
+
+        // The camera flies, but still collides with the world
+        Body camera;
+        camera.position = cameraPos;
+        camera.halfExtents = {0.2f, 0.2f, 0.2f};
+        camera.gravity = false;
+        camera.stepHeight = 0.0f;
+        player = physics.addBody(camera);
+
+        Fluid::registerHandlers(ticker);
+
+        // Give render a state to draw before the first tick lands
+        auto& initial = state.back();
+        initial.cameraPos = cameraPos;
+        initial.mesh = currentMesh;
+        state.publish();
         hasInitialized = true;
     }
 }
@@ -1,12 +1,49 @@
 #pragma once
 
+#include <memory>
+#include <mutex>
+
 #include "Frame.h"
+#include "../Threads/StateBuffer.h"
+#include "../World/World.h"
+#include "../World/Raycast.h"
+#include "../World/BlockTicker.h"
+#include "../Physics/Physics.h"
+#include "../Render/Benchmark.h"
+#include "../Render/CameraPath.h"
+#include "../Render/ChunkBounds.h"
+#include "../Render/GpuCuller.h"
+#include "../Render/GpuProfiler.h"
+#include "../Render/MeshPool.h"
 
 class TestFrame : public Frame {
 public:
+    struct Options {
+        // Repeat the mesh's draws up to this many per frame, for stressing command recording
+        uint32_t syntheticDraws = 0;
+        // Record draws into secondary command buffers on the scheduler's workers
+        bool parallelRecording = true;
+        // Frustum and occlusion cull in a compute pass and draw what survives indirectly
+        bool gpuCulling = true;
+        // Split each chunk's draw by face direction and leave out directions facing away from the camera
+        bool faceSplitting = true;
+        // Draw the nearest chunks first, so early depth testing skips shading what they hide
+        bool depthSorting = true;
+        // Fly the camera along this path, one timestep per rendered frame, instead of following input
+        std::shared_ptr<const CameraPath> cameraPath;
+        // Gets a sample for every rendered frame when set
+        Benchmark* benchmark = nullptr;
+        // Save the camera's path to this file when the frame goes away, for replaying it later
+        std::string recordPath;
+    };
+
     explicit TestFrame(Engine& engine);
+    TestFrame(Engine& engine, Options options);
+    ~TestFrame() override;
 
-    void update(float dt, Context& context) override;
+    void input() override;
+
+    void update(float dt) override;
 
     void render(Context& context) override;
 
@@ -17,40 +54,149 @@ public:
 private:
     void gen();
     void mesh();
-
-    glm::vec3 cameraPos{2.0f, 2.0f, 2.0f};
+    void setActiveAround(const glm::ivec3& chunkPos, bool active);
+    static glm::vec3 targetFromAngles(const glm::vec2& angles);
+
+    // Orders ids by the distance from eye to their draw's bounds, nearest first
+    void sortFrontToBack(std::vector<uint32_t>& ids, const glm::vec3& eye);
+    // Orders the translucent draws furthest first, once the eye has moved into another chunk
+    void sortBackToFront(const glm::vec3& eye);
+    void addFaceDraws(const MeshPool::Draw& draw, const std::array<uint32_t, 6>& faceCounts, const glm::vec3& eye);
+    void bindPipeline(VkCommandBuffer commandBuffer, Context& context, VkPipeline pipeline) const;
+    void record(VkCommandBuffer commandBuffer, Context& context, VkPipeline pipeline, uint32_t first,
+                uint32_t count) const;
+    void recordTranslucent(VkCommandBuffer commandBuffer, Context& context) const;
+    void recordParallel(VkCommandBuffer primary, Context& context, Context::FrameResources& frame,
+                        VkRenderPassBeginInfo& renderPassInfo);
+
+    Options options;
+
+    glm::vec3 cameraPos{2.5f, 2.5f, 2.5f};
     glm::vec2 cameraAngles{225.0f, -35.0f};
+    // Where the mouse has turned the camera, kept on the main thread. Render looks along it straight away
+    // instead of waiting for a tick to take it, the simulation gets a copy with the rest of the input.
+    glm::vec2 lookAngles = cameraAngles;
     glm::vec3 cameraTarget{0.0f, 0.0f, 0.0f};
 
     float lastMouseX = 0.0f;
     float lastMouseY = 0.0f;
+    bool firstInput = true;
     float sens = 0.05;
-    float speed = 0.0005;
+    float speed = 5.0f;
+    float reach = 8.0f;
+
+    RayHit picked;
+    bool lastClick = false;
+    bool lastWireframeKey = false;
+    bool lastTraceKey = false;
+    // Toggled with F, drawn with the opaque pipeline until the wireframe one has compiled
+    bool wireframe = false;
 
     Context::MVP mvp = {};
 
-    struct Vertex {
-        glm::vec3 pos;
-        glm::vec3 color;
+    // Input sampled on the main thread since the last update
+    struct Input {
+        bool forward = false;
+        bool back = false;
+        bool left = false;
+        bool right = false;
+        bool click = false;
+        glm::vec2 angles{0.0f, 0.0f};
+    };
+    std::mutex inputMutex;
+    Input pendingInput;
+
+    // A chunk's slice of the mesh and where it sits, bounds relative to the origin. Its indices are
+    // grouped by face direction, SOUTH first, with faceCounts indices in each group.
+    struct Draw {
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        int32_t vertexOffset;
+        glm::vec3 origin;
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+        std::array<uint32_t, 6> faceCounts;
+    };
+
+    struct Mesh {
+        std::vector<float> verts;
+        std::vector<uint16_t> indices;
+        std::vector<Draw> draws;
+        // The water in each chunk, in the same buffers
+        std::vector<Draw> translucentDraws;
     };
 
-    struct VoxelFace {
-        bool transparent;
-        int type;
-        int side;
-
-        bool operator==(VoxelFace& other) {
-            return transparent == other.transparent &&
-                   type == other.type;
-        }
-        bool operator!=(VoxelFace& other) {
-            return transparent != other.transparent &&
-                   type != other.type;
-        }
+    // Everything render needs from a simulation tick
+    struct State {
+        glm::vec3 cameraPos{0.0f, 0.0f, 0.0f};
+        std::shared_ptr<const Mesh> mesh;
     };
+    StateBuffer<State> state;
+    std::shared_ptr<const Mesh> uploadedMesh;
+    MeshPool::Mesh pooledMesh;
+    std::vector<MeshPool::Draw> drawList;
+    std::vector<std::array<uint32_t, 6>> drawFaces;
+    // Without GPU culling, the draws whose bounds pass the frustum test this frame
+    ChunkBounds drawBounds;
+    std::vector<uint32_t> visibleIds;
+    // Every draw's id, for the GPU path to sort and hand over
+    std::vector<uint32_t> drawOrder;
+    std::vector<std::pair<float, uint32_t>> sortKeys;
+    // Blended over the opaque draws back to front. There are few of them, so they are always culled on the
+    // CPU, after the sort so the order survives.
+    std::vector<MeshPool::Draw> translucentList;
+    std::vector<std::array<uint32_t, 6>> translucentFaces;
+    ChunkBounds translucentBounds;
+    std::vector<uint32_t> translucentIds;
+    std::vector<uint32_t> translucentOrder;
+    std::vector<uint8_t> translucentVisible;
+    glm::ivec3 sortedChunk{0};
+    bool translucentSorted = false;
+    // frameDraws holds the opaque draws first, the translucent ones start here
+    uint32_t opaqueDrawCount = 0;
+    // What goes to the mesh pool this frame, after culling and face splitting
+    std::vector<MeshPool::Draw> frameDraws;
+    uint64_t frameTriangles = 0;
+
+    // Below this many draws per worker, handing recording off costs more than it saves
+    static constexpr size_t MIN_DRAWS_PER_SLICE = 256;
 
-    std::array<std::array<std::array<VoxelFace, 3>, 3>, 3> voxels {};
+    struct Vertex {
+        glm::vec3 pos;
+        glm::vec3 color;
+    };
 
+    // Blocks gen fills and mesh covers: x and z within the radius, y from the floor up to the water source
+    static constexpr int WORLD_RADIUS = 8;
+    static constexpr int WORLD_BOTTOM = -2;
+    static constexpr int WORLD_TOP = 2;
+    // Synthetic copies of the mesh are this far apart, clear of the chunks it covers
+    static constexpr float COPY_SPACING = 2.0f * Chunk::SIZE;
+    // Chunks around the camera's that get random ticks
+    static constexpr int ACTIVE_RADIUS = 1;
+
+    World world;
+    Physics physics;
+    BlockTicker ticker;
+    Physics::BodyId player = 0;
+    glm::ivec3 activeChunk{0};
+    bool hasActiveChunks = false;
+    // The ticker's change count the current mesh was built at
+    uint64_t meshedChanges = 0;
+
+    static constexpr uint32_t POOL_VERTICES = 1 << 20;
+    static constexpr uint32_t POOL_INDICES = 1 << 22;
+    MeshPool meshPool;
+    // Null when GPU culling is off or the device cannot draw from GPU written commands
+    std::unique_ptr<GpuCuller> culler;
+    PipelineRegistry::Id opaquePipeline;
+    PipelineRegistry::Id wireframePipeline;
+    PipelineRegistry::Id translucentPipeline;
+    // Picked once per frame, recording threads only bind them
+    VkPipeline framePipeline = VK_NULL_HANDLE;
+    VkPipeline frameTranslucentPipeline = VK_NULL_HANDLE;
+
+    // Face directions, by outward normal: SOUTH +z, NORTH -z, EAST +x, WEST -x, TOP +y, BOTTOM -y
     static constexpr int SOUTH = 0;
     static constexpr int NORTH = 1;
     static constexpr int EAST = 2;
@@ -69,21 +215,28 @@ private:
         -1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f    // 7 front left bottom
     };
 
+    // In face direction order
     std::vector<uint16_t> cubeIndices = {
-        2, 1, 0, 0, 3, 2, // back
-        4, 5, 6, 6, 7, 4, // front
-        3, 0, 4, 4, 7, 3, // left
-        5, 1, 2, 2, 6, 5, // right
-        4, 0, 1, 1, 5, 4, // top
-        2, 3, 7, 7, 6, 2  // bottom
+        4, 5, 6, 6, 7, 4, // front, SOUTH
+        2, 1, 0, 0, 3, 2, // back, NORTH
+        5, 1, 2, 2, 6, 5, // right, EAST
+        3, 0, 4, 4, 7, 3, // left, WEST
+        2, 3, 7, 7, 6, 2, // y = 0, TOP
+        4, 0, 1, 1, 5, 4  // y = -1, BOTTOM
     };
 
-    std::vector<float> verts {};
-    std::vector<uint16_t> indices {};
+    std::shared_ptr<const Mesh> currentMesh;
     int count = 1;
 
+    // Null when the device cannot write timestamps from its graphics queue
+    std::unique_ptr<GpuProfiler> gpuProfiler;
+    CameraPath recordedPath;
+    float recordedTime = 0.0f;
+    uint64_t renderedFrames = 0;
+
     float lastIntegral = 0.0f;
     float frameTime = 0.0f;
+    float recordTime = 0.0f;
     int frameCount;
 };
 
@@ -1,14 +1,118 @@
+#include <cctype>
 #include <iostream>
+#include <string>
 #include "Engine.h"
 #include "Frames/TestFrame.h"
+#include "Render/Benchmark.h"
+#include "Render/CameraPath.h"
+#include "Render/CullBenchmark.h"
+#include "World/TickBenchmark.h"
 
-int main() {
-    Engine engine;
-    TestFrame frame(engine);
+int main(int argc, char** argv) {
+    // Needs no window, so it runs before the engine starts
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--bench-cull") {
+            uint32_t chunks = 100000;
+            if (i + 1 < argc && std::isdigit(static_cast<unsigned char>(argv[i + 1][0])))
+                chunks = static_cast<uint32_t>(std::stoul(argv[i + 1]));
+            benchmarkCulling(chunks);
+            return 0;
+        }
+        if (std::string(argv[i]) == "--bench-ticks") {
+            uint32_t chunks = 1024;
+            if (i + 1 < argc && std::isdigit(static_cast<unsigned char>(argv[i + 1][0])))
+                chunks = static_cast<uint32_t>(std::stoul(argv[i + 1]));
+            benchmarkTicks(chunks);
+            return 0;
+        }
+    }
+
+    Engine::Options engineOptions;
+    TestFrame::Options options;
+    float fps = 0.0f;
+    bool lowLatency = false;
+    std::string benchmarkPath;
+    std::string cameraPath;
+    bool windowed = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--fps" && i + 1 < argc)
+            fps = std::stof(argv[++i]);
+        else if (arg == "--low-latency")
+            lowLatency = true;
+        else if (arg == "--draws" && i + 1 < argc)
+            options.syntheticDraws = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (arg == "--serial-record")
+            options.parallelRecording = false;
+        else if (arg == "--cpu-draws")
+            options.gpuCulling = false;
+        else if (arg == "--no-face-split")
+            options.faceSplitting = false;
+        else if (arg == "--no-depth-sort")
+            options.depthSorting = false;
+        else if (arg == "--headless")
+            engineOptions.headless = true;
+        else if (arg == "--frames" && i + 1 < argc)
+            engineOptions.frames = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (arg == "--size" && i + 2 < argc) {
+            engineOptions.width = static_cast<uint32_t>(std::stoul(argv[++i]));
+            engineOptions.height = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--capture" && i + 1 < argc)
+            engineOptions.capturePath = argv[++i];
+        else if (arg == "--benchmark") {
+            benchmarkPath = "benchmark.json";
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                benchmarkPath = argv[++i];
+        } else if (arg == "--windowed")
+            windowed = true;
+        else if (arg == "--camera-path" && i + 1 < argc)
+            cameraPath = argv[++i];
+        else if (arg == "--record-camera" && i + 1 < argc)
+            options.recordPath = argv[++i];
+        else if (arg == "--trace" && i + 1 < argc)
+            engineOptions.tracePath = argv[++i];
+    }
+
+    // The same world, draws and flight every run, headless unless asked otherwise
+    if (!benchmarkPath.empty()) {
+        engineOptions.headless = !windowed;
+        if (engineOptions.frames == 0)
+            engineOptions.frames = 600;
+        if (options.syntheticDraws == 0)
+            options.syntheticDraws = 20000;
+    }
+
+    // Replayed flights tick with the frames, so the water has spread the same way at every frame
+    if (!benchmarkPath.empty() || !cameraPath.empty())
+        engineOptions.lockstep = true;
+
+    // Headless runs on build machines would otherwise never end
+    if (engineOptions.headless && engineOptions.frames == 0)
+        engineOptions.frames = 1000;
 
     try {
-        engine.changeFrame<TestFrame>(frame);
+        if (!cameraPath.empty())
+            options.cameraPath = std::make_shared<const CameraPath>(CameraPath::load(cameraPath));
+        else if (!benchmarkPath.empty())
+            options.cameraPath = std::make_shared<const CameraPath>(CameraPath::flythrough());
+
+        // Outlives the engine, whose frame hands it samples
+        Benchmark benchmark;
+        if (!benchmarkPath.empty())
+            options.benchmark = &benchmark;
+
+        Engine engine(engineOptions);
+        engine.pacer().setTargetFps(fps);
+        engine.pacer().setLowLatency(lowLatency);
+        engine.changeFrame<TestFrame>(engine, options);
         engine.launch();
+
+        if (!benchmarkPath.empty()) {
+            VkPhysicalDeviceProperties properties;
+            vkGetPhysicalDeviceProperties(engine.context().m_physicalDevice, &properties);
+            benchmark.write(benchmarkPath, properties.deviceName);
+        }
     } catch (std::runtime_error& err) {
         std::cerr << err.what() << std::endl;
         return 1;
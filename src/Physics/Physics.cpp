@@ -0,0 +1,195 @@
+#include "Physics.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "../Threads/Scheduler.h"
+
+namespace {
+    // Faces closer than this are treated as touching, absorbs rounding after snapping to a face
+    constexpr float epsilon = 1e-4f;
+
+    bool overlapsAxis(const AABB& a, const AABB& b, int axis) {
+        return a.max[axis] > b.min[axis] + epsilon && a.min[axis] < b.max[axis] - epsilon;
+    }
+}
+
+float AABB::clip(const AABB& box, int axis, float delta) const {
+    for (int i = 0; i < 3; i++)
+        if (i != axis && !overlapsAxis(box, *this, i))
+            return delta;
+
+    if (delta > 0.0f && box.max[axis] <= min[axis] + epsilon)
+        delta = std::min(delta, min[axis] - box.max[axis]);
+    else if (delta < 0.0f && box.min[axis] >= max[axis] - epsilon)
+        delta = std::max(delta, max[axis] - box.min[axis]);
+
+    return delta;
+}
+
+Physics::Physics(const World& world, Scheduler* scheduler) : m_world(world), m_scheduler(scheduler) {}
+
+Physics::BodyId Physics::addBody(const Body& body) {
+    BodyId id;
+    if (!m_freeIds.empty()) {
+        // Reuse the lowest free id so the body order only depends on the add/remove sequence
+        auto lowest = std::min_element(m_freeIds.begin(), m_freeIds.end());
+        id = *lowest;
+        m_freeIds.erase(lowest);
+        m_bodies[id] = body;
+    } else {
+        id = static_cast<BodyId>(m_bodies.size());
+        m_bodies.push_back(body);
+    }
+
+    m_bodies[id].previousPosition = body.position;
+    m_bodies[id].active = true;
+    return id;
+}
+
+void Physics::removeBody(BodyId id) {
+    m_bodies[id].active = false;
+    m_freeIds.push_back(id);
+}
+
+Body& Physics::body(BodyId id) {
+    return m_bodies[id];
+}
+
+int Physics::update(float dt) {
+    m_accumulator += dt;
+
+    int steps = 0;
+    while (m_accumulator >= TIMESTEP) {
+        step();
+        m_accumulator -= TIMESTEP;
+        steps++;
+    }
+
+    return steps;
+}
+
+void Physics::step() {
+    int count = static_cast<int>(m_bodies.size());
+    if (m_scheduler && count >= PARALLEL_THRESHOLD) {
+        auto futures = m_scheduler->runRange([this](int i) {
+            if (m_bodies[i].active)
+                integrate(m_bodies[i]);
+        }, 0, count);
+    } else {
+        for (auto& body : m_bodies)
+            if (body.active)
+                integrate(body);
+    }
+
+    m_tick++;
+}
+
+float Physics::alpha() const {
+    return m_accumulator / TIMESTEP;
+}
+
+uint64_t Physics::tick() const {
+    return m_tick;
+}
+
+void Physics::integrate(Body& body) const {
+    body.previousPosition = body.position;
+
+    if (body.gravity)
+        body.velocity.y = std::max(body.velocity.y + GRAVITY * TIMESTEP, TERMINAL_VELOCITY);
+
+    glm::vec3 delta = body.velocity * TIMESTEP;
+    AABB box = body.bounds();
+
+    // Broadphase: bodies whose swept box only touches empty or unloaded chunks skip the voxel tests
+    AABB reach = box.sweep(delta);
+    reach.max.y += body.stepHeight;
+    if (!nearSolid(reach)) {
+        body.position += delta;
+        body.onGround = false;
+        return;
+    }
+
+    thread_local std::vector<AABB> boxes;
+    glm::vec3 moved = move(box, delta, boxes);
+
+    bool blockedX = moved.x != delta.x;
+    bool blockedZ = moved.z != delta.z;
+    bool landed = delta.y < 0.0f && moved.y != delta.y;
+
+    // Step up: retry the horizontal move from stepHeight above, then settle back down
+    if ((blockedX || blockedZ) && (body.onGround || landed) && body.stepHeight > 0.0f) {
+        AABB stepBox = body.bounds();
+        glm::vec3 up = move(stepBox, {0.0f, body.stepHeight, 0.0f}, boxes);
+        glm::vec3 across = move(stepBox, {delta.x, 0.0f, delta.z}, boxes);
+        glm::vec3 down = move(stepBox, {0.0f, -up.y + std::min(delta.y, 0.0f), 0.0f}, boxes);
+
+        float steppedDistance = across.x * across.x + across.z * across.z;
+        float movedDistance = moved.x * moved.x + moved.z * moved.z;
+        if (steppedDistance > movedDistance) {
+            box = stepBox;
+            moved = {across.x, up.y + down.y, across.z};
+            blockedX = across.x != delta.x;
+            blockedZ = across.z != delta.z;
+            landed = true;
+        }
+    }
+
+    body.position = (box.min + box.max) * 0.5f;
+    body.onGround = landed;
+    if (blockedX)
+        body.velocity.x = 0.0f;
+    if (moved.y != delta.y)
+        body.velocity.y = 0.0f;
+    if (blockedZ)
+        body.velocity.z = 0.0f;
+}
+
+bool Physics::nearSolid(const AABB& region) const {
+    auto first = World::chunkPos(glm::ivec3(glm::floor(region.min)));
+    auto last = World::chunkPos(glm::ivec3(glm::floor(region.max)));
+
+    for (int x = first.x; x <= last.x; x++)
+        for (int y = first.y; y <= last.y; y++)
+            for (int z = first.z; z <= last.z; z++) {
+                const Chunk* chunk = m_world.getChunk({x, y, z});
+                if (chunk && chunk->hasSolid())
+                    return true;
+            }
+
+    return false;
+}
+
+void Physics::collectBoxes(const AABB& region, std::vector<AABB>& boxes) const {
+    boxes.clear();
+
+    glm::ivec3 first(glm::floor(region.min));
+    glm::ivec3 last(glm::floor(region.max));
+    for (int x = first.x; x <= last.x; x++)
+        for (int y = first.y; y <= last.y; y++)
+            for (int z = first.z; z <= last.z; z++)
+                if (isSolid(m_world.getBlock({x, y, z}))) {
+                    glm::vec3 min(static_cast<float>(x), static_cast<float>(y), static_cast<float>(z));
+                    boxes.push_back({min, min + glm::vec3(1.0f, 1.0f, 1.0f)});
+                }
+}
+
+glm::vec3 Physics::move(AABB& box, const glm::vec3& delta, std::vector<AABB>& boxes) const {
+    collectBoxes(box.sweep(delta), boxes);
+
+    // Resolve one axis at a time, vertical first so landing takes priority over sliding
+    glm::vec3 moved(0.0f, 0.0f, 0.0f);
+    for (int axis : {1, 0, 2}) {
+        float d = delta[axis];
+        for (const auto& other : boxes)
+            d = other.clip(box, axis, d);
+
+        glm::vec3 offset(0.0f, 0.0f, 0.0f);
+        offset[axis] = d;
+        box = box.offset(offset);
+        moved[axis] = d;
+    }
+
+    return moved;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "../World/World.h"
+
+class Scheduler;
+
+struct AABB {
+    glm::vec3 min;
+    glm::vec3 max;
+
+    AABB offset(const glm::vec3& delta) const {
+        return {min + delta, max + delta};
+    }
+
+    AABB sweep(const glm::vec3& delta) const {
+        return {glm::min(min, min + delta), glm::max(max, max + delta)};
+    }
+
+    // Clamps a movement of box along axis so it stops at this box's face
+    float clip(const AABB& box, int axis, float delta) const;
+};
+
+struct Body {
+    glm::vec3 position{0.0f, 0.0f, 0.0f};
+    glm::vec3 velocity{0.0f, 0.0f, 0.0f};
+    glm::vec3 halfExtents{0.3f, 0.9f, 0.3f};
+    float stepHeight = 0.6f;
+    bool gravity = true;
+    bool onGround = false;
+
+    // Position at the start of the last tick, for interpolating between ticks when rendering
+    glm::vec3 previousPosition{0.0f, 0.0f, 0.0f};
+    bool active = true;
+
+    AABB bounds() const {
+        return {position - halfExtents, position + halfExtents};
+    }
+};
+
+// Fixed timestep rigid AABB simulation against the voxel world.
+// Bodies only collide with blocks, so a tick gives the same result no matter how bodies are spread over threads.
+class Physics {
+public:
+    using BodyId = uint32_t;
+
+    static constexpr float TIMESTEP = 1.0f / 60.0f;
+    static constexpr float GRAVITY = -20.0f;
+    static constexpr float TERMINAL_VELOCITY = -50.0f;
+
+    explicit Physics(const World& world, Scheduler* scheduler = nullptr);
+
+    BodyId addBody(const Body& body);
+    void removeBody(BodyId id);
+    Body& body(BodyId id);
+
+    // Accumulates dt and runs as many whole ticks as fit, returns the number of ticks run
+    int update(float dt);
+    void step();
+
+    // How far the accumulator is into the next tick, in [0, 1)
+    float alpha() const;
+    uint64_t tick() const;
+
+private:
+    void integrate(Body& body) const;
+    bool nearSolid(const AABB& region) const;
+    void collectBoxes(const AABB& region, std::vector<AABB>& boxes) const;
+    glm::vec3 move(AABB& box, const glm::vec3& delta, std::vector<AABB>& boxes) const;
+
+    static constexpr int PARALLEL_THRESHOLD = 256;
+
+    const World& m_world;
+    Scheduler* m_scheduler;
+
+    std::vector<Body> m_bodies;
+    std::vector<BodyId> m_freeIds;
+
+    float m_accumulator = 0.0f;
+    uint64_t m_tick = 0;
+};
@@ -0,0 +1,138 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+    struct Summary {
+        double mean = 0.0;
+        double p50 = 0.0;
+        double p95 = 0.0;
+        double p99 = 0.0;
+        double max = 0.0;
+    };
+
+    // Nearest rank percentiles
+    Summary summarise(std::vector<double> values) {
+        Summary summary;
+        if (values.empty())
+            return summary;
+
+        std::sort(values.begin(), values.end());
+        auto rank = [&](double percentile) {
+            auto index = static_cast<size_t>(percentile / 100.0 * static_cast<double>(values.size() - 1) + 0.5);
+            return values[std::min(index, values.size() - 1)];
+        };
+        for (auto value : values)
+            summary.mean += value;
+        summary.mean /= static_cast<double>(values.size());
+        summary.p50 = rank(50.0);
+        summary.p95 = rank(95.0);
+        summary.p99 = rank(99.0);
+        summary.max = values.back();
+        return summary;
+    }
+
+    void writeSummary(std::ostream& out, const Summary& summary) {
+        out << "{\"mean\": " << summary.mean << ", \"p50\": " << summary.p50 << ", \"p95\": " << summary.p95
+            << ", \"p99\": " << summary.p99 << ", \"max\": " << summary.max << "}";
+    }
+
+    std::string escape(const std::string& text) {
+        std::string escaped;
+        for (char c : text) {
+            if (c == '"' || c == '\\')
+                escaped += '\\';
+            escaped += c;
+        }
+        return escaped;
+    }
+}
+
+Benchmark::Benchmark(uint32_t warmupFrames) : m_warmupFrames(warmupFrames) {}
+
+void Benchmark::add(const Sample& sample) {
+    if (m_skipped < m_warmupFrames) {
+        m_skipped++;
+        return;
+    }
+    m_samples.push_back(sample);
+}
+
+void Benchmark::addGpuScope(const std::string& name, float ms) {
+    // Scopes belong to the last sample added, warm-up frames are left out
+    if (m_samples.empty())
+        return;
+    m_gpuScopes[name].push_back(ms);
+}
+
+void Benchmark::addMemory(const vk::Allocator::Stats& stats) {
+    if (stats.used > m_peakMemory.used)
+        m_peakMemory = stats;
+}
+
+size_t Benchmark::size() const {
+    return m_samples.size();
+}
+
+void Benchmark::write(const std::string& path, const std::string& device) const {
+    std::vector<double> cpu;
+    std::vector<double> gpu;
+    std::vector<double> draws;
+    std::vector<double> triangles;
+    std::vector<double> overdraw;
+    for (auto& sample : m_samples) {
+        if (sample.overdraw >= 0.0f)
+            overdraw.push_back(sample.overdraw);
+        cpu.push_back(sample.cpuMs);
+        if (sample.gpuMs >= 0.0f)
+            gpu.push_back(sample.gpuMs);
+        draws.push_back(sample.draws);
+        triangles.push_back(static_cast<double>(sample.triangles));
+    }
+    auto cpuSummary = summarise(cpu);
+    auto gpuSummary = summarise(gpu);
+
+    std::ofstream file(path);
+    if (!file.is_open())
+        throw std::runtime_error("Failed to open benchmark report!");
+
+    file << "{\n";
+    file << "  \"device\": \"" << escape(device) << "\",\n";
+    file << "  \"frames\": " << m_samples.size() << ",\n";
+    file << "  \"warmupFrames\": " << m_warmupFrames << ",\n";
+    file << "  \"cpuFrameMs\": ";
+    writeSummary(file, cpuSummary);
+    file << ",\n  \"gpuFrameMs\": ";
+    if (gpu.empty())
+        file << "null";
+    else
+        writeSummary(file, gpuSummary);
+    file << ",\n  \"gpuScopesMs\": {";
+    for (auto it = m_gpuScopes.begin(); it != m_gpuScopes.end(); it++) {
+        file << (it == m_gpuScopes.begin() ? "\n" : ",\n") << "    \"" << escape(it->first) << "\": ";
+        writeSummary(file, summarise(it->second));
+    }
+    file << (m_gpuScopes.empty() ? "},\n" : "\n  },\n");
+    file << "  \"drawCalls\": ";
+    writeSummary(file, summarise(draws));
+    file << ",\n  \"triangles\": ";
+    writeSummary(file, summarise(triangles));
+    file << ",\n  \"overdraw\": ";
+    if (overdraw.empty())
+        file << "null";
+    else
+        writeSummary(file, summarise(overdraw));
+    file << ",\n";
+    file << "  \"memory\": {\"usedBytes\": " << m_peakMemory.used << ", \"reservedBytes\": " << m_peakMemory.reserved
+         << ", \"blocks\": " << m_peakMemory.blocks << ", \"allocations\": " << m_peakMemory.allocations << "}\n";
+    file << "}\n";
+
+    std::cout << m_samples.size() << " frames on " << device << ": cpu p50 " << cpuSummary.p50 << " ms, p95 "
+              << cpuSummary.p95 << " ms, p99 " << cpuSummary.p99 << " ms";
+    if (!gpu.empty())
+        std::cout << ", gpu p50 " << gpuSummary.p50 << " ms, p99 " << gpuSummary.p99 << " ms";
+    std::cout << ", " << m_peakMemory.used / (1024 * 1024) << " MiB used, written to " << path << std::endl;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../Vulkan/Allocator.h"
+
+// Per frame measurements of a benchmark run, summarised as percentiles and written out as JSON so runs
+// can be compared against each other. The first frames warm caches and pipelines and are left out.
+class Benchmark {
+public:
+    struct Sample {
+        float cpuMs;
+        // Negative when the GPU's time is not known
+        float gpuMs;
+        uint32_t draws;
+        uint64_t triangles;
+        // Fragments shaded per pixel, negative when not known
+        float overdraw;
+    };
+
+    explicit Benchmark(uint32_t warmupFrames = 10);
+
+    void add(const Sample& sample);
+    // Time of a named stretch of the frame on the GPU, alongside the frame's sample
+    void addGpuScope(const std::string& name, float ms);
+    // Keeps the largest usage seen
+    void addMemory(const vk::Allocator::Stats& stats);
+
+    size_t size() const;
+
+    // Prints a summary and writes the report, device is recorded alongside the numbers
+    void write(const std::string& path, const std::string& device) const;
+
+private:
+    uint32_t m_warmupFrames;
+    uint32_t m_skipped = 0;
+    std::vector<Sample> m_samples;
+    std::map<std::string, std::vector<double>> m_gpuScopes;
+    vk::Allocator::Stats m_peakMemory;
+};
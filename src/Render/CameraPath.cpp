@@ -0,0 +1,93 @@
+#include "CameraPath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+    glm::vec3 direction(const glm::vec2& angles) {
+        return {std::cos(glm::radians(angles.y)) * std::cos(glm::radians(angles.x)),
+                std::sin(glm::radians(angles.y)),
+                std::cos(glm::radians(angles.y)) * std::sin(glm::radians(angles.x))};
+    }
+}
+
+CameraPath CameraPath::load(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open())
+        throw std::runtime_error("Failed to open camera path!");
+
+    CameraPath cameraPath;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream fields(line);
+        Key key;
+        if (!(fields >> key.time >> key.position.x >> key.position.y >> key.position.z >> key.angles.x >> key.angles.y))
+            throw std::runtime_error("Invalid camera path key!");
+        cameraPath.add(key);
+    }
+    return cameraPath;
+}
+
+void CameraPath::save(const std::string& path) const {
+    std::ofstream file(path);
+    if (!file.is_open())
+        throw std::runtime_error("Failed to open camera path!");
+
+    file << "# time x y z yaw pitch\n";
+    for (auto& key : m_keys)
+        file << key.time << " " << key.position.x << " " << key.position.y << " " << key.position.z << " "
+             << key.angles.x << " " << key.angles.y << "\n";
+}
+
+CameraPath CameraPath::flythrough() {
+    // Synthetic draws are laid out 64 to a row, 4 units apart, starting at the origin
+    CameraPath path;
+    path.add({0.0f, {-20.0f, 12.0f, -20.0f}, {45.0f, -20.0f}});
+    path.add({3.0f, {60.0f, 20.0f, 40.0f}, {30.0f, -30.0f}});
+    path.add({6.0f, {180.0f, 40.0f, 80.0f}, {120.0f, -45.0f}});
+    path.add({8.0f, {240.0f, 15.0f, 20.0f}, {200.0f, -15.0f}});
+    path.add({10.0f, {128.0f, 80.0f, -40.0f}, {90.0f, -60.0f}});
+    return path;
+}
+
+void CameraPath::add(const Key& key) {
+    if (!m_keys.empty() && key.time < m_keys.back().time)
+        throw std::runtime_error("Camera path keys are out of order!");
+    m_keys.push_back(key);
+}
+
+CameraPath::Pose CameraPath::sample(float time) const {
+    if (m_keys.empty())
+        return {glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f)};
+
+    auto next = std::upper_bound(m_keys.begin(), m_keys.end(), time, [](float t, const Key& key) {
+        return t < key.time;
+    });
+    if (next == m_keys.begin())
+        return {next->position, direction(next->angles)};
+    if (next == m_keys.end())
+        return {m_keys.back().position, direction(m_keys.back().angles)};
+
+    auto& a = *(next - 1);
+    auto& b = *next;
+    float span = b.time - a.time;
+    float t = span > 0.0f ? (time - a.time) / span : 1.0f;
+
+    // Yaw wraps at 360, so turn the short way round
+    glm::vec2 turn = b.angles - a.angles;
+    turn.x = std::fmod(turn.x + 540.0f, 360.0f) - 180.0f;
+    return {glm::mix(a.position, b.position, t), direction(a.angles + turn * t)};
+}
+
+float CameraPath::duration() const {
+    return m_keys.empty() ? 0.0f : m_keys.back().time;
+}
+
+bool CameraPath::empty() const {
+    return m_keys.empty();
+}
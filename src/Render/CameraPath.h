@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Camera keyframes over time, for replaying the same flight through the world on every run. Angles are
+// yaw and pitch in degrees, the way TestFrame steers its camera.
+class CameraPath {
+public:
+    struct Key {
+        float time;
+        glm::vec3 position;
+        glm::vec2 angles;
+    };
+
+    struct Pose {
+        glm::vec3 position;
+        // Unit look direction, not a point to look at
+        glm::vec3 direction;
+    };
+
+    // One "time x y z yaw pitch" key per line, lines starting with # are skipped
+    static CameraPath load(const std::string& path);
+    void save(const std::string& path) const;
+
+    // A fixed flight over the synthetic draw grid, for when no path is given
+    static CameraPath flythrough();
+
+    // Keys have to be added in time order
+    void add(const Key& key);
+
+    // Interpolated between the keys around time, held at the ends
+    Pose sample(float time) const;
+    float duration() const;
+    bool empty() const;
+
+private:
+    std::vector<Key> m_keys;
+};
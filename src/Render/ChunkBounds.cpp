@@ -0,0 +1,233 @@
+#include "ChunkBounds.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#define CHUNK_BOUNDS_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+    constexpr uint32_t ALL_PLANES = (1u << 6) - 1;
+
+    // Planes the box straddles, none when it is fully inside. Sets outside when one plane rejects it outright.
+    uint32_t straddledPlanes(const Frustum& frustum, const glm::vec3& min, const glm::vec3& max, bool& outside) {
+        uint32_t mask = 0;
+        outside = false;
+        for (uint32_t i = 0; i < 6; i++) {
+            auto& plane = frustum.planes[i];
+            glm::vec3 normal(plane);
+            glm::vec3 positive(plane.x >= 0.0f ? max.x : min.x, plane.y >= 0.0f ? max.y : min.y,
+                               plane.z >= 0.0f ? max.z : min.z);
+            glm::vec3 negative(plane.x >= 0.0f ? min.x : max.x, plane.y >= 0.0f ? min.y : max.y,
+                               plane.z >= 0.0f ? min.z : max.z);
+            if (glm::dot(normal, positive) + plane.w < 0.0f) {
+                outside = true;
+                return 0;
+            }
+            if (glm::dot(normal, negative) + plane.w < 0.0f)
+                mask |= 1u << i;
+        }
+        return mask;
+    }
+
+    // The corner furthest along a plane's normal comes from max on positive axes and min on negative
+    // ones. The plane is the same for every box, so that choice is made once per plane, not per box.
+    struct PlaneTest {
+        const float* x;
+        const float* y;
+        const float* z;
+        glm::vec4 plane;
+    };
+
+    template <typename Region>
+    uint32_t planeTests(const Region& region, const Frustum& frustum, uint32_t mask, PlaneTest* tests) {
+        uint32_t count = 0;
+        for (uint32_t i = 0; i < 6; i++) {
+            if (!(mask & (1u << i)))
+                continue;
+            auto& plane = frustum.planes[i];
+            tests[count++] = {plane.x >= 0.0f ? region.maxX.data() : region.minX.data(),
+                              plane.y >= 0.0f ? region.maxY.data() : region.minY.data(),
+                              plane.z >= 0.0f ? region.maxZ.data() : region.minZ.data(),
+                              plane};
+        }
+        return count;
+    }
+
+    template <typename Region>
+    void emit(const Region& region, size_t first, uint32_t bits, std::vector<uint32_t>& visible) {
+        for (uint32_t lane = 0; lane < ChunkBounds::BATCH; lane++) {
+            if (bits & (1u << lane))
+                visible.push_back(region.ids[first + lane]);
+        }
+    }
+
+    template <typename Region>
+    void testScalar(const Region& region, const PlaneTest* tests, uint32_t testCount, std::vector<uint32_t>& visible) {
+        for (size_t i = 0; i < region.ids.size(); i++) {
+            bool inside = true;
+            for (uint32_t t = 0; t < testCount && inside; t++) {
+                auto& p = tests[t].plane;
+                inside = p.x * tests[t].x[i] + p.y * tests[t].y[i] + p.z * tests[t].z[i] + p.w >= 0.0f;
+            }
+            if (inside)
+                visible.push_back(region.ids[i]);
+        }
+    }
+
+#ifdef CHUNK_BOUNDS_X86
+    // Two halves of four per batch, SSE is baseline on x86-64
+    template <typename Region>
+    void testSse(const Region& region, const PlaneTest* tests, uint32_t testCount, std::vector<uint32_t>& visible) {
+        size_t count = region.ids.size();
+        for (size_t i = 0; i < count; i += ChunkBounds::BATCH) {
+            __m128 outsideLo = _mm_setzero_ps();
+            __m128 outsideHi = _mm_setzero_ps();
+            for (uint32_t t = 0; t < testCount; t++) {
+                auto& test = tests[t];
+                __m128 nx = _mm_set1_ps(test.plane.x);
+                __m128 ny = _mm_set1_ps(test.plane.y);
+                __m128 nz = _mm_set1_ps(test.plane.z);
+                __m128 d = _mm_set1_ps(test.plane.w);
+
+                __m128 lo = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_loadu_ps(test.x + i)),
+                                                  _mm_mul_ps(ny, _mm_loadu_ps(test.y + i))),
+                                       _mm_add_ps(_mm_mul_ps(nz, _mm_loadu_ps(test.z + i)), d));
+                __m128 hi = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_loadu_ps(test.x + i + 4)),
+                                                  _mm_mul_ps(ny, _mm_loadu_ps(test.y + i + 4))),
+                                       _mm_add_ps(_mm_mul_ps(nz, _mm_loadu_ps(test.z + i + 4)), d));
+                outsideLo = _mm_or_ps(outsideLo, _mm_cmplt_ps(lo, _mm_setzero_ps()));
+                outsideHi = _mm_or_ps(outsideHi, _mm_cmplt_ps(hi, _mm_setzero_ps()));
+            }
+
+            auto outside = static_cast<uint32_t>(_mm_movemask_ps(outsideLo) | (_mm_movemask_ps(outsideHi) << 4));
+            auto valid = static_cast<uint32_t>(std::min<size_t>(count - i, ChunkBounds::BATCH));
+            emit(region, i, ~outside & ((1u << valid) - 1), visible);
+        }
+    }
+#endif
+
+#if defined(CHUNK_BOUNDS_X86) && defined(__GNUC__)
+#define CHUNK_BOUNDS_AVX2
+    // Compiled for AVX2 on its own and only called when the CPU reports it, the rest of the build stays baseline
+    template <typename Region>
+    __attribute__((target("avx2")))
+    void testAvx2(const Region& region, const PlaneTest* tests, uint32_t testCount, std::vector<uint32_t>& visible) {
+        size_t count = region.ids.size();
+        for (size_t i = 0; i < count; i += ChunkBounds::BATCH) {
+            __m256 outside = _mm256_setzero_ps();
+            for (uint32_t t = 0; t < testCount; t++) {
+                auto& test = tests[t];
+                __m256 distance = _mm256_add_ps(
+                        _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(test.plane.x), _mm256_loadu_ps(test.x + i)),
+                                      _mm256_mul_ps(_mm256_set1_ps(test.plane.y), _mm256_loadu_ps(test.y + i))),
+                        _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(test.plane.z), _mm256_loadu_ps(test.z + i)),
+                                      _mm256_set1_ps(test.plane.w)));
+                outside = _mm256_or_ps(outside, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_LT_OQ));
+            }
+
+            auto valid = static_cast<uint32_t>(std::min<size_t>(count - i, ChunkBounds::BATCH));
+            emit(region, i, ~static_cast<uint32_t>(_mm256_movemask_ps(outside)) & ((1u << valid) - 1), visible);
+        }
+    }
+#endif
+}
+
+void ChunkBounds::clear() {
+    m_regions.clear();
+    m_regionIndex.clear();
+    m_size = 0;
+}
+
+void ChunkBounds::add(uint32_t id, const glm::vec3& min, const glm::vec3& max) {
+    auto regionX = static_cast<int32_t>(std::floor((min.x + max.x) * 0.5f / REGION_SIZE));
+    auto regionZ = static_cast<int32_t>(std::floor((min.z + max.z) * 0.5f / REGION_SIZE));
+    uint64_t key = (static_cast<uint64_t>(static_cast<uint32_t>(regionX)) << 32) | static_cast<uint32_t>(regionZ);
+
+    auto found = m_regionIndex.find(key);
+    if (found == m_regionIndex.end()) {
+        found = m_regionIndex.emplace(key, m_regions.size()).first;
+        m_regions.emplace_back();
+        m_regions.back().min = min;
+        m_regions.back().max = max;
+    }
+
+    auto& region = m_regions[found->second];
+    region.min = glm::min(region.min, min);
+    region.max = glm::max(region.max, max);
+
+    size_t index = region.ids.size();
+    if (index % BATCH == 0) {
+        for (auto* axis : {&region.minX, &region.minY, &region.minZ, &region.maxX, &region.maxY, &region.maxZ})
+            axis->resize(index + BATCH, 0.0f);
+    }
+    region.minX[index] = min.x;
+    region.minY[index] = min.y;
+    region.minZ[index] = min.z;
+    region.maxX[index] = max.x;
+    region.maxY[index] = max.y;
+    region.maxZ[index] = max.z;
+    region.ids.push_back(id);
+    m_size++;
+}
+
+void ChunkBounds::cull(const Frustum& frustum, std::vector<uint32_t>& visible, Path path, bool hierarchical) const {
+    auto best = bestPath();
+    if (path == Path::Auto || static_cast<int>(path) > static_cast<int>(best))
+        path = best;
+
+    PlaneTest tests[6];
+    for (auto& region : m_regions) {
+        uint32_t mask = ALL_PLANES;
+        if (hierarchical) {
+            bool outside;
+            mask = straddledPlanes(frustum, region.min, region.max, outside);
+            if (outside)
+                continue;
+            // Every chunk in a region that is fully inside is visible without looking at it
+            if (mask == 0) {
+                visible.insert(visible.end(), region.ids.begin(), region.ids.end());
+                continue;
+            }
+        }
+
+        // Only the planes the region straddles can reject one of its chunks
+        uint32_t testCount = planeTests(region, frustum, mask, tests);
+        switch (path) {
+#ifdef CHUNK_BOUNDS_AVX2
+        case Path::Avx2:
+            testAvx2(region, tests, testCount, visible);
+            break;
+#endif
+#ifdef CHUNK_BOUNDS_X86
+        case Path::Sse:
+            testSse(region, tests, testCount, visible);
+            break;
+#endif
+        default:
+            testScalar(region, tests, testCount, visible);
+            break;
+        }
+    }
+}
+
+size_t ChunkBounds::size() const {
+    return m_size;
+}
+
+size_t ChunkBounds::regionCount() const {
+    return m_regions.size();
+}
+
+ChunkBounds::Path ChunkBounds::bestPath() {
+#if defined(CHUNK_BOUNDS_AVX2)
+    static const Path best = __builtin_cpu_supports("avx2") ? Path::Avx2 : Path::Sse;
+    return best;
+#elif defined(CHUNK_BOUNDS_X86)
+    return Path::Sse;
+#else
+    return Path::Scalar;
+#endif
+}
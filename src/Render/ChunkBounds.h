@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Frustum.h"
+#include "../World/Chunk.h"
+
+// Chunk AABBs stored as structure of arrays and grouped into regions of chunk columns. Culling tests a
+// region first and only looks at its chunks when the region straddles the frustum, eight at a time.
+class ChunkBounds {
+public:
+    // Which chunk test cull runs, Auto takes the widest the CPU supports
+    enum class Path { Auto, Scalar, Sse, Avx2 };
+
+    // Columns along each side of a region, a region spans its columns' full height
+    static constexpr int REGION_COLUMNS = 8;
+    static constexpr float REGION_SIZE = static_cast<float>(REGION_COLUMNS * Chunk::SIZE);
+    static constexpr size_t BATCH = 8;
+
+    void clear();
+    // Files the box under the region its centre falls in, cull hands id back when it is visible
+    void add(uint32_t id, const glm::vec3& min, const glm::vec3& max);
+
+    // Appends the id of every box touching the frustum. Without the hierarchy every box is tested.
+    void cull(const Frustum& frustum, std::vector<uint32_t>& visible, Path path = Path::Auto,
+              bool hierarchical = true) const;
+
+    size_t size() const;
+    size_t regionCount() const;
+
+    static Path bestPath();
+
+private:
+    struct Region {
+        glm::vec3 min{0.0f};
+        glm::vec3 max{0.0f};
+        // Padded with empty boxes to a whole number of batches, ids only covers the real ones
+        std::vector<float> minX, minY, minZ;
+        std::vector<float> maxX, maxY, maxZ;
+        std::vector<uint32_t> ids;
+    };
+
+    std::vector<Region> m_regions;
+    std::unordered_map<uint64_t, size_t> m_regionIndex;
+    size_t m_size = 0;
+};
@@ -0,0 +1,80 @@
+#include "CullBenchmark.h"
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "ChunkBounds.h"
+
+void benchmarkCulling(uint32_t chunks, uint32_t frames) {
+    // Square of chunk columns around the origin
+    constexpr int COLUMN_HEIGHT = 8;
+    auto side = static_cast<int>(std::ceil(std::sqrt(chunks / static_cast<double>(COLUMN_HEIGHT))));
+    ChunkBounds bounds;
+    for (uint32_t i = 0; i < chunks; i++) {
+        int column = static_cast<int>(i) / COLUMN_HEIGHT;
+        glm::vec3 min(column % side - side / 2, static_cast<int>(i) % COLUMN_HEIGHT, column / side - side / 2);
+        min *= static_cast<float>(Chunk::SIZE);
+        bounds.add(i, min, min + glm::vec3(static_cast<float>(Chunk::SIZE)));
+    }
+
+    auto proj = glm::perspective(glm::radians(70.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+    proj[1][1] *= -1;
+    glm::vec3 eye(0.0f, 80.0f, 0.0f);
+    std::vector<Frustum> frusta;
+    for (uint32_t frame = 0; frame < frames; frame++) {
+        float yaw = glm::radians(360.0f * frame / frames);
+        float pitch = glm::radians(-15.0f);
+        glm::vec3 target(std::cos(pitch) * std::cos(yaw), std::sin(pitch), std::cos(pitch) * std::sin(yaw));
+        frusta.emplace_back(proj * glm::lookAt(eye, eye + target, glm::vec3(0.0f, 1.0f, 0.0f)));
+    }
+
+    struct Run {
+        const char* name;
+        ChunkBounds::Path path;
+        bool hierarchical;
+    };
+    const Run runs[] = {
+        {"scalar", ChunkBounds::Path::Scalar, false},
+        {"scalar + regions", ChunkBounds::Path::Scalar, true},
+        {"sse", ChunkBounds::Path::Sse, false},
+        {"sse + regions", ChunkBounds::Path::Sse, true},
+        {"avx2", ChunkBounds::Path::Avx2, false},
+        {"avx2 + regions", ChunkBounds::Path::Avx2, true},
+    };
+
+    std::cout << "Culling " << bounds.size() << " chunks in " << bounds.regionCount() << " regions over "
+              << frames << " frames" << std::endl;
+
+    std::vector<uint32_t> visible;
+    visible.reserve(chunks);
+    double baseline = 0.0;
+    for (auto& run : runs) {
+        if (static_cast<int>(run.path) > static_cast<int>(ChunkBounds::bestPath())) {
+            std::cout << run.name << ": not supported on this CPU" << std::endl;
+            continue;
+        }
+
+        // Warm the caches so the first run is not penalised
+        visible.clear();
+        bounds.cull(frusta[0], visible, run.path, run.hierarchical);
+
+        size_t total = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (auto& frustum : frusta) {
+            visible.clear();
+            bounds.cull(frustum, visible, run.path, run.hierarchical);
+            total += visible.size();
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+        if (baseline == 0.0)
+            baseline = ms;
+
+        std::cout << run.name << ": " << ms << " ms per frame, " << total / frames << " visible, "
+                  << baseline / ms << "x" << std::endl;
+    }
+}
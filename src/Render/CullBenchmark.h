@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cstdint>
+
+// Culls a synthetic world of the given number of chunks from a camera turning in place, once per frame,
+// with every ChunkBounds path with and without the region hierarchy, and prints the timings
+void benchmarkCulling(uint32_t chunks, uint32_t frames = 1000);
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <array>
+
+#include <glm/glm.hpp>
+
+// The six clip planes of a view projection, normals pointing inwards. Depth runs from 0 to 1 as in Vulkan.
+struct Frustum {
+    enum Plane { Left, Right, Bottom, Top, Near, Far };
+
+    std::array<glm::vec4, 6> planes;
+
+    explicit Frustum(const glm::mat4& viewProj) {
+        auto row = [&](int i) {
+            return glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]);
+        };
+        planes[Left] = row(3) + row(0);
+        planes[Right] = row(3) - row(0);
+        planes[Bottom] = row(3) + row(1);
+        planes[Top] = row(3) - row(1);
+        planes[Near] = row(2);
+        planes[Far] = row(3) - row(2);
+        for (auto& plane : planes)
+            plane /= glm::length(glm::vec3(plane));
+    }
+
+    // Conservative, boxes near a frustum corner can pass while lying outside it
+    bool intersects(const glm::vec3& min, const glm::vec3& max) const {
+        for (auto& plane : planes) {
+            // The corner furthest along the plane normal
+            glm::vec3 corner(plane.x >= 0.0f ? max.x : min.x,
+                             plane.y >= 0.0f ? max.y : min.y,
+                             plane.z >= 0.0f ? max.z : min.z);
+            if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+                return false;
+        }
+        return true;
+    }
+};
@@ -0,0 +1,411 @@
+#include "GpuCuller.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "Frustum.h"
+
+GpuCuller::GpuCuller(Context& context, PipelineRegistry& pipelines) : m_context(context), m_pipelines(pipelines) {
+    // Counted draws still go through maxDrawIndirectCount, which is 1 without multi draw
+    m_compact = context.m_drawIndexedIndirectCount != nullptr && context.m_features.multiDrawIndirect;
+
+    createLayouts();
+    createPipelines();
+    createPyramid();
+
+    for (auto& frame : m_frames) {
+        frame.data = context.createHostBuffer(sizeof(CullData), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+        frame.count = context.createHostBuffer(sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                                 VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                                                 VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+        *static_cast<uint32_t*>(frame.count.memory.mapped) = 0;
+    }
+
+    createDescriptors();
+}
+
+GpuCuller::~GpuCuller() {
+    auto device = m_context.m_device;
+    vkDeviceWaitIdle(device);
+
+    for (auto& frame : m_frames) {
+        m_context.release(frame.data);
+        m_context.release(frame.commands);
+        m_context.release(frame.count);
+    }
+
+    vkDestroyDescriptorPool(device, m_descriptorPool, nullptr);
+    vkDestroySampler(device, m_sampler, nullptr);
+    for (auto& view : m_levelViews)
+        vkDestroyImageView(device, view, nullptr);
+    vkDestroyImageView(device, m_pyramidView, nullptr);
+    m_context.destroyImage(m_pyramid);
+
+    vkDestroyPipelineLayout(device, m_cullLayout, nullptr);
+    vkDestroyPipelineLayout(device, m_pyramidLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, m_cullSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, m_pyramidSetLayout, nullptr);
+}
+
+bool GpuCuller::supported(const Context& context) {
+    return context.m_features.drawIndirectFirstInstance;
+}
+
+void GpuCuller::createLayouts() {
+    auto binding = [](uint32_t index, VkDescriptorType type) {
+        VkDescriptorSetLayoutBinding layoutBinding = {};
+        layoutBinding.binding = index;
+        layoutBinding.descriptorType = type;
+        layoutBinding.descriptorCount = 1;
+        layoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        return layoutBinding;
+    };
+
+    auto createSetLayout = [&](const std::vector<VkDescriptorSetLayoutBinding>& bindings, VkDescriptorSetLayout& layout) {
+        VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+        if (vkCreateDescriptorSetLayout(m_context.m_device, &layoutInfo, nullptr, &layout) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create descriptor set layout!");
+    };
+
+    createSetLayout({binding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER),
+                     binding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER),
+                     binding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER),
+                     binding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER),
+                     binding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER),
+                     binding(5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER)}, m_cullSetLayout);
+    createSetLayout({binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER),
+                     binding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE)}, m_pyramidSetLayout);
+
+    auto createPipelineLayout = [&](VkDescriptorSetLayout& setLayout, VkPipelineLayout& layout) {
+        VkPipelineLayoutCreateInfo layoutInfo = {};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        layoutInfo.setLayoutCount = 1;
+        layoutInfo.pSetLayouts = &setLayout;
+        if (vkCreatePipelineLayout(m_context.m_device, &layoutInfo, nullptr, &layout) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create pipeline layout!");
+    };
+
+    createPipelineLayout(m_cullSetLayout, m_cullLayout);
+    createPipelineLayout(m_pyramidSetLayout, m_pyramidLayout);
+}
+
+void GpuCuller::createPipelines() {
+    PipelineRegistry::Desc cull;
+    cull.name = "culling pipeline";
+    cull.computeShader = "Shaders/cull.spv";
+    cull.layout = m_cullLayout;
+    m_cullPipeline = m_pipelines.add(cull);
+
+    PipelineRegistry::Desc pyramid;
+    pyramid.name = "depth pyramid pipeline";
+    pyramid.computeShader = "Shaders/hiz.spv";
+    pyramid.layout = m_pyramidLayout;
+    m_pyramidPipeline = m_pipelines.add(pyramid);
+}
+
+void GpuCuller::createPyramid() {
+    VkExtent2D size = {std::max(1u, (m_context.m_swapChainExtent.width + 1) / 2),
+                       std::max(1u, (m_context.m_swapChainExtent.height + 1) / 2)};
+    m_levelSizes.push_back(size);
+    while (size.width > 1 || size.height > 1) {
+        size = {std::max(1u, (size.width + 1) / 2), std::max(1u, (size.height + 1) / 2)};
+        m_levelSizes.push_back(size);
+    }
+    auto levels = static_cast<uint32_t>(m_levelSizes.size());
+
+    VkImageCreateInfo imageInfo = {};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = VK_FORMAT_R32_SFLOAT;
+    imageInfo.extent = {m_levelSizes[0].width, m_levelSizes[0].height, 1};
+    imageInfo.mipLevels = levels;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    m_pyramid = m_context.createImage(imageInfo);
+
+    auto createView = [&](uint32_t baseLevel, uint32_t levelCount) {
+        VkImageViewCreateInfo viewInfo = {};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = m_pyramid.image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = VK_FORMAT_R32_SFLOAT;
+        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.baseMipLevel = baseLevel;
+        viewInfo.subresourceRange.levelCount = levelCount;
+        viewInfo.subresourceRange.baseArrayLayer = 0;
+        viewInfo.subresourceRange.layerCount = 1;
+
+        VkImageView view;
+        if (vkCreateImageView(m_context.m_device, &viewInfo, nullptr, &view) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create image view!");
+        return view;
+    };
+
+    m_pyramidView = createView(0, levels);
+    for (uint32_t level = 0; level < levels; level++)
+        m_levelViews.push_back(createView(level, 1));
+
+    // Only ever read with texelFetch, the sampler just has to cover every level
+    VkSamplerCreateInfo samplerInfo = {};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.maxLod = static_cast<float>(levels);
+    if (vkCreateSampler(m_context.m_device, &samplerInfo, nullptr, &m_sampler) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create sampler!");
+}
+
+void GpuCuller::createDescriptors() {
+    auto levels = static_cast<uint32_t>(m_levelViews.size());
+    auto frames = static_cast<uint32_t>(m_frames.size());
+
+    VkDescriptorPoolSize poolSizes[] = {
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, frames},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4 * frames},
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, frames + levels},
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, levels}
+    };
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = 4;
+    poolInfo.pPoolSizes = poolSizes;
+    poolInfo.maxSets = frames + levels;
+    if (vkCreateDescriptorPool(m_context.m_device, &poolInfo, nullptr, &m_descriptorPool) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create descriptor pool!");
+
+    auto allocate = [&](VkDescriptorSetLayout layout) {
+        VkDescriptorSetAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = m_descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &layout;
+
+        VkDescriptorSet set;
+        if (vkAllocateDescriptorSets(m_context.m_device, &allocInfo, &set) != VK_SUCCESS)
+            throw std::runtime_error("Failed to allocate descriptor sets!");
+        return set;
+    };
+
+    // The buffers that never change are written once, draw buffers every frame
+    for (auto& frame : m_frames) {
+        frame.set = allocate(m_cullSetLayout);
+
+        VkDescriptorBufferInfo dataInfo = {frame.data.buffer, 0, sizeof(CullData)};
+        VkDescriptorBufferInfo countInfo = {frame.count.buffer, 0, sizeof(uint32_t)};
+        VkDescriptorImageInfo pyramidInfo = {m_sampler, m_pyramidView, VK_IMAGE_LAYOUT_GENERAL};
+
+        std::array<VkWriteDescriptorSet, 3> writes = {};
+        for (auto& write : writes) {
+            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.dstSet = frame.set;
+            write.descriptorCount = 1;
+        }
+        writes[0].dstBinding = 0;
+        writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        writes[0].pBufferInfo = &dataInfo;
+        writes[1].dstBinding = 4;
+        writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[1].pBufferInfo = &countInfo;
+        writes[2].dstBinding = 5;
+        writes[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writes[2].pImageInfo = &pyramidInfo;
+        vkUpdateDescriptorSets(m_context.m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+
+    // Each level reads the one above it, the first level's source is set along with the depth buffer
+    for (uint32_t level = 0; level < levels; level++) {
+        auto set = allocate(m_pyramidSetLayout);
+        m_levelSets.push_back(set);
+
+        VkDescriptorImageInfo sourceInfo = {m_sampler, level > 0 ? m_levelViews[level - 1] : VK_NULL_HANDLE,
+                                            VK_IMAGE_LAYOUT_GENERAL};
+        VkDescriptorImageInfo targetInfo = {VK_NULL_HANDLE, m_levelViews[level], VK_IMAGE_LAYOUT_GENERAL};
+
+        std::array<VkWriteDescriptorSet, 2> writes = {};
+        for (auto& write : writes) {
+            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.dstSet = set;
+            write.descriptorCount = 1;
+        }
+        writes[0].dstBinding = 1;
+        writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        writes[0].pImageInfo = &targetInfo;
+        writes[1].dstBinding = 0;
+        writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writes[1].pImageInfo = &sourceInfo;
+        vkUpdateDescriptorSets(m_context.m_device, level > 0 ? 2 : 1, writes.data(), 0, nullptr);
+    }
+}
+
+void GpuCuller::updateDescriptors(FrameCull& frame, const MeshPool::FrameDraws& draws) {
+    VkDescriptorBufferInfo bufferInfos[] = {
+        {draws.commands.buffer, 0, VK_WHOLE_SIZE},
+        {draws.bounds.buffer, 0, VK_WHOLE_SIZE},
+        {frame.commands.buffer, 0, VK_WHOLE_SIZE}
+    };
+
+    std::array<VkWriteDescriptorSet, 3> writes = {};
+    for (uint32_t i = 0; i < writes.size(); i++) {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = frame.set;
+        writes[i].dstBinding = i + 1;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[i].pBufferInfo = &bufferInfos[i];
+    }
+    vkUpdateDescriptorSets(m_context.m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+void GpuCuller::setDepthSource(VkImageView depthView) {
+    VkDescriptorImageInfo sourceInfo = {m_sampler, depthView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL};
+
+    VkWriteDescriptorSet write = {};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = m_levelSets[0];
+    write.dstBinding = 0;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.pImageInfo = &sourceInfo;
+
+    // The set may still be in use by frames in flight
+    m_context.waitFrames();
+    vkUpdateDescriptorSets(m_context.m_device, 1, &write, 0, nullptr);
+    m_hasDepth = true;
+}
+
+void GpuCuller::cull(VkCommandBuffer commandBuffer, const MeshPool& pool, const glm::mat4& viewProj,
+                     uint32_t count) {
+    auto& draws = pool.frameDraws();
+    auto& frame = m_frames[m_context.m_currentFrame];
+    frame.drawCount = std::min(count, draws.count);
+
+    // The pyramid is bound whether or not occlusion is on, so it needs a valid layout from the start
+    if (!m_pyramidInitialized) {
+        VkImageMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = m_pyramid.image;
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, static_cast<uint32_t>(m_levelViews.size()), 0, 1};
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             0, 0, nullptr, 0, nullptr, 1, &barrier);
+        m_pyramidInitialized = true;
+    }
+
+    // beginFrame waited on this slot, so the count its last frame wrote is final
+    auto visible = static_cast<uint32_t*>(frame.count.memory.mapped);
+    m_visibleCount = *visible;
+    if (frame.drawCount == 0) {
+        *visible = 0;
+        return;
+    }
+
+    if (frame.commands.size < draws.commands.size) {
+        m_context.release(frame.commands);
+        frame.commands = m_context.createDeviceBuffer(draws.commands.size, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                                                           VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    }
+    updateDescriptors(frame, draws);
+
+    CullData data = {};
+    data.viewProj = viewProj;
+    data.pyramidViewProj = m_pyramidViewProj;
+    Frustum frustum(viewProj);
+    std::copy(frustum.planes.begin(), frustum.planes.end(), data.planes);
+    data.pyramidSize = glm::vec2(m_levelSizes[0].width, m_levelSizes[0].height);
+    data.drawCount = frame.drawCount;
+    data.flags = (m_compact ? CULL_COMPACT : 0) | (m_pyramidReady ? CULL_OCCLUSION : 0);
+    std::memcpy(frame.data.memory.mapped, &data, sizeof(data));
+
+    // Clearing the count and the last pyramid build both have to land before the dispatch
+    vkCmdFillBuffer(commandBuffer, frame.count.buffer, 0, sizeof(uint32_t), 0);
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelines.get(m_cullPipeline));
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullLayout, 0, 1, &frame.set, 0, nullptr);
+    vkCmdDispatch(commandBuffer, (frame.drawCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+    // The draw reads the commands and count, the host reads the count once the frame retires
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr,
+                         0, nullptr);
+}
+
+void GpuCuller::draw(VkCommandBuffer commandBuffer, const MeshPool& pool) const {
+    auto& frame = m_frames[m_context.m_currentFrame];
+    if (frame.drawCount == 0)
+        return;
+
+    pool.bind(commandBuffer);
+    constexpr uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+    if (m_compact) {
+        m_context.m_drawIndexedIndirectCount(commandBuffer, frame.commands.buffer, 0, frame.count.buffer, 0,
+                                             frame.drawCount, stride);
+    } else if (!m_context.m_features.multiDrawIndirect) {
+        for (uint32_t i = 0; i < frame.drawCount; i++)
+            vkCmdDrawIndexedIndirect(commandBuffer, frame.commands.buffer, static_cast<VkDeviceSize>(i) * stride, 1,
+                                     stride);
+    } else {
+        vkCmdDrawIndexedIndirect(commandBuffer, frame.commands.buffer, 0, frame.drawCount, stride);
+    }
+}
+
+void GpuCuller::buildPyramid(VkCommandBuffer commandBuffer, const glm::mat4& viewProj) {
+    if (!m_hasDepth || !m_pyramidInitialized)
+        return;
+
+    // Depth writes from the render pass, and this frame's cull still reading the old pyramid
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelines.get(m_pyramidPipeline));
+    for (size_t level = 0; level < m_levelSets.size(); level++) {
+        if (level > 0) {
+            barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+        }
+
+        auto& size = m_levelSizes[level];
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pyramidLayout, 0, 1,
+                                &m_levelSets[level], 0, nullptr);
+        vkCmdDispatch(commandBuffer, (size.width + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE,
+                      (size.height + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE, 1);
+    }
+
+    m_pyramidViewProj = viewProj;
+    m_pyramidReady = true;
+}
+
+uint32_t GpuCuller::visibleCount() const {
+    return m_visibleCount;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "../Context.h"
+#include "MeshPool.h"
+#include "PipelineRegistry.h"
+
+// Culls a MeshPool's prepared draws in a compute pass, against the frustum and against a depth pyramid
+// built from the previous frame. With VK_KHR_draw_indirect_count the survivors are compacted and drawn
+// with a GPU side count, otherwise culled draws keep their slot with zero instances.
+class GpuCuller {
+public:
+    // Registers its pipelines, they are built by the registry's next compile()
+    GpuCuller(Context& context, PipelineRegistry& pipelines);
+    ~GpuCuller();
+
+    GpuCuller(const GpuCuller&) = delete;
+    GpuCuller& operator=(const GpuCuller&) = delete;
+
+    // Indirect draws have to select their origin through firstInstance
+    static bool supported(const Context& context);
+
+    // Records the cull dispatch for the first count prepared draws, outside the render pass. Any after
+    // those are left for the caller to draw.
+    void cull(VkCommandBuffer commandBuffer, const MeshPool& pool, const glm::mat4& viewProj, uint32_t count);
+    // Draws whatever the last cull kept, inside the render pass
+    void draw(VkCommandBuffer commandBuffer, const MeshPool& pool) const;
+
+    // Depth the pyramid is reduced from, sampled in DEPTH_STENCIL_READ_ONLY_OPTIMAL. Occlusion culling
+    // stays off until this is set and a pyramid has been built.
+    void setDepthSource(VkImageView depthView);
+    // Reduces the frame's depth into the pyramid after its render pass, for the next frame's occlusion test
+    void buildPyramid(VkCommandBuffer commandBuffer, const glm::mat4& viewProj);
+
+    // Draws that passed culling in the last frame to finish in the current slot
+    uint32_t visibleCount() const;
+
+private:
+    static constexpr uint32_t CULL_GROUP_SIZE = 64;
+    static constexpr uint32_t PYRAMID_GROUP_SIZE = 8;
+    static constexpr uint32_t CULL_OCCLUSION = 1;
+    static constexpr uint32_t CULL_COMPACT = 2;
+
+    // Matches CullData in cull.comp, std140
+    struct CullData {
+        glm::mat4 viewProj;
+        glm::mat4 pyramidViewProj;
+        glm::vec4 planes[6];
+        glm::vec2 pyramidSize;
+        uint32_t drawCount;
+        uint32_t flags;
+    };
+
+    struct FrameCull {
+        Context::Buffer data;
+        Context::Buffer commands;
+        // Host visible, so the visible count can be read back once the slot retires
+        Context::Buffer count;
+        VkDescriptorSet set = VK_NULL_HANDLE;
+        // Draws handed to the last cull
+        uint32_t drawCount = 0;
+    };
+
+    void createLayouts();
+    void createPipelines();
+    void createPyramid();
+    void createDescriptors();
+    void updateDescriptors(FrameCull& frame, const MeshPool::FrameDraws& draws);
+
+    Context& m_context;
+    PipelineRegistry& m_pipelines;
+    bool m_compact;
+
+    VkDescriptorSetLayout m_cullSetLayout;
+    VkDescriptorSetLayout m_pyramidSetLayout;
+    VkPipelineLayout m_cullLayout;
+    VkPipelineLayout m_pyramidLayout;
+    PipelineRegistry::Id m_cullPipeline;
+    PipelineRegistry::Id m_pyramidPipeline;
+    VkDescriptorPool m_descriptorPool;
+
+    // Max depth pyramid, level 0 is half the swap chain's size
+    Context::Image m_pyramid;
+    VkImageView m_pyramidView;
+    std::vector<VkImageView> m_levelViews;
+    std::vector<VkExtent2D> m_levelSizes;
+    std::vector<VkDescriptorSet> m_levelSets;
+    VkSampler m_sampler;
+    bool m_hasDepth = false;
+    bool m_pyramidReady = false;
+    bool m_pyramidInitialized = false;
+    glm::mat4 m_pyramidViewProj{1.0f};
+
+    std::array<FrameCull, Context::MAX_FRAMES_IN_FLIGHT> m_frames;
+    uint32_t m_visibleCount = 0;
+};
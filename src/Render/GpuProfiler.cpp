@@ -0,0 +1,164 @@
+#include "GpuProfiler.h"
+
+#include <stdexcept>
+
+namespace {
+    uint32_t graphicsTimestampBits(const Context& context) {
+        uint32_t count = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(context.m_physicalDevice, &count, nullptr);
+        std::vector<VkQueueFamilyProperties> families(count);
+        vkGetPhysicalDeviceQueueFamilyProperties(context.m_physicalDevice, &count, families.data());
+        return context.m_graphicsFamily < count ? families[context.m_graphicsFamily].timestampValidBits : 0;
+    }
+}
+
+GpuProfiler::GpuProfiler(Context& context) : m_context(context) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(context.m_physicalDevice, &properties);
+    m_period = properties.limits.timestampPeriod;
+
+    auto bits = graphicsTimestampBits(context);
+    m_validMask = bits >= 64 ? ~0ull : (1ull << bits) - 1;
+
+    VkQueryPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    poolInfo.queryCount = MAX_QUERIES * Context::MAX_FRAMES_IN_FLIGHT;
+    if (vkCreateQueryPool(context.m_device, &poolInfo, nullptr, &m_queryPool) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create query pool!");
+
+    m_timestamps.resize(MAX_QUERIES);
+
+    if (context.m_features.pipelineStatisticsQuery) {
+        poolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        poolInfo.queryCount = Context::MAX_FRAMES_IN_FLIGHT;
+        poolInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+        if (vkCreateQueryPool(context.m_device, &poolInfo, nullptr, &m_statisticsPool) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create query pool!");
+    }
+}
+
+GpuProfiler::~GpuProfiler() {
+    vkDeviceWaitIdle(m_context.m_device);
+    vkDestroyQueryPool(m_context.m_device, m_queryPool, nullptr);
+    if (m_statisticsPool != VK_NULL_HANDLE)
+        vkDestroyQueryPool(m_context.m_device, m_statisticsPool, nullptr);
+}
+
+bool GpuProfiler::supported(const Context& context) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(context.m_physicalDevice, &properties);
+    return properties.limits.timestampComputeAndGraphics || graphicsTimestampBits(context) > 0;
+}
+
+void GpuProfiler::beginFrame(VkCommandBuffer commandBuffer) {
+    auto slot = m_context.m_currentFrame;
+    auto& frame = m_frames[slot];
+
+    // beginFrame waited on the slot's fence, so whatever it wrote last time is ready
+    if (frame.used > 0)
+        resolve(frame, slot);
+
+    frame.used = 0;
+    frame.pending = 0;
+    frame.scopes.clear();
+    frame.open.clear();
+    frame.countedFragments = false;
+    vkCmdResetQueryPool(commandBuffer, m_queryPool, slot * MAX_QUERIES, MAX_QUERIES);
+    if (m_statisticsPool != VK_NULL_HANDLE)
+        vkCmdResetQueryPool(commandBuffer, m_statisticsPool, slot, 1);
+    write(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+}
+
+void GpuProfiler::endFrame(VkCommandBuffer commandBuffer) {
+    auto& frame = m_frames[m_context.m_currentFrame];
+    while (!frame.open.empty())
+        end(commandBuffer);
+    write(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+}
+
+void GpuProfiler::begin(VkCommandBuffer commandBuffer, const char* name) {
+    auto& frame = m_frames[m_context.m_currentFrame];
+    // Open scopes' ends and the frame's end are already spoken for, scopes past that are dropped
+    if (frame.used + frame.pending + 3 > MAX_QUERIES) {
+        frame.open.push_back(SIZE_MAX);
+        return;
+    }
+
+    auto depth = static_cast<uint32_t>(frame.open.size());
+    frame.open.push_back(frame.scopes.size());
+    frame.pending++;
+    // Bottom of pipe on both ends, so a scope starts once the work before it is done
+    frame.scopes.push_back({name, write(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT), 0, depth});
+}
+
+void GpuProfiler::end(VkCommandBuffer commandBuffer) {
+    auto& frame = m_frames[m_context.m_currentFrame];
+    if (frame.open.empty())
+        throw std::runtime_error("GPU profiler scope ended without being begun!");
+
+    auto index = frame.open.back();
+    frame.open.pop_back();
+    if (index != SIZE_MAX) {
+        frame.pending--;
+        frame.scopes[index].last = write(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+    }
+}
+
+void GpuProfiler::beginFragments(VkCommandBuffer commandBuffer) {
+    if (m_statisticsPool != VK_NULL_HANDLE)
+        vkCmdBeginQuery(commandBuffer, m_statisticsPool, m_context.m_currentFrame, 0);
+}
+
+void GpuProfiler::endFragments(VkCommandBuffer commandBuffer) {
+    if (m_statisticsPool == VK_NULL_HANDLE)
+        return;
+    vkCmdEndQuery(commandBuffer, m_statisticsPool, m_context.m_currentFrame);
+    m_frames[m_context.m_currentFrame].countedFragments = true;
+}
+
+VkQueryPipelineStatisticFlags GpuProfiler::inheritedStatistics() const {
+    return m_statisticsPool != VK_NULL_HANDLE ? VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT : 0;
+}
+
+float GpuProfiler::frameMs() const {
+    return m_frameMs;
+}
+
+const std::vector<GpuProfiler::Scope>& GpuProfiler::scopes() const {
+    return m_scopes;
+}
+
+int64_t GpuProfiler::fragments() const {
+    return m_fragments;
+}
+
+uint32_t GpuProfiler::write(VkCommandBuffer commandBuffer, VkPipelineStageFlagBits stage) {
+    auto slot = m_context.m_currentFrame;
+    auto query = m_frames[slot].used++;
+    vkCmdWriteTimestamp(commandBuffer, stage, m_queryPool, slot * MAX_QUERIES + query);
+    return query;
+}
+
+void GpuProfiler::resolve(FrameQueries& frame, uint32_t slot) {
+    if (vkGetQueryPoolResults(m_context.m_device, m_queryPool, slot * MAX_QUERIES, frame.used,
+                              frame.used * sizeof(uint64_t), m_timestamps.data(), sizeof(uint64_t),
+                              VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+        return;
+
+    auto ms = [&](uint32_t first, uint32_t last) {
+        auto ticks = (m_timestamps[last] & m_validMask) - (m_timestamps[first] & m_validMask);
+        return static_cast<float>(static_cast<double>(ticks) * m_period / 1e6);
+    };
+    m_frameMs = ms(0, frame.used - 1);
+    m_scopes.clear();
+    for (auto& scope : frame.scopes)
+        m_scopes.push_back({scope.name, ms(scope.first, scope.last), scope.depth});
+
+    uint64_t fragments = 0;
+    m_fragments = -1;
+    if (frame.countedFragments &&
+        vkGetQueryPoolResults(m_context.m_device, m_statisticsPool, slot, 1, sizeof(fragments), &fragments,
+                              sizeof(fragments), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+        m_fragments = static_cast<int64_t>(fragments);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../Context.h"
+
+// Times named stretches of a frame's command buffer on the GPU with timestamp queries. Each frame slot
+// has its own queries, which are read when the slot comes round again and its fence has signalled, so
+// results trail recording by MAX_FRAMES_IN_FLIGHT frames and reading them never waits on the GPU.
+// Where the device has pipeline statistics it can also count the fragments shaded in part of a frame.
+class GpuProfiler {
+public:
+    struct Scope {
+        std::string name;
+        float ms;
+        // Scopes opened inside another one are one deeper
+        uint32_t depth;
+    };
+
+    explicit GpuProfiler(Context& context);
+    ~GpuProfiler();
+
+    GpuProfiler(const GpuProfiler&) = delete;
+    GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+    // The graphics queue has to be able to write timestamps
+    static bool supported(const Context& context);
+
+    // First and last thing recorded into the frame's primary command buffer, outside any render pass
+    void beginFrame(VkCommandBuffer commandBuffer);
+    void endFrame(VkCommandBuffer commandBuffer);
+
+    // Scopes nest and are closed in reverse order. Names have to outlive the frame, literals do.
+    void begin(VkCommandBuffer commandBuffer, const char* name);
+    void end(VkCommandBuffer commandBuffer);
+
+    // Counts fragment shader invocations in between, once per frame and outside any render pass. Does
+    // nothing without pipeline statistics.
+    void beginFragments(VkCommandBuffer commandBuffer);
+    void endFragments(VkCommandBuffer commandBuffer);
+    // What secondary command buffers executed in between have to inherit, 0 without pipeline statistics
+    VkQueryPipelineStatisticFlags inheritedStatistics() const;
+
+    // GPU time of the newest finished frame in milliseconds, negative until there is one
+    float frameMs() const;
+    // That frame's scopes, in the order they were opened
+    const std::vector<Scope>& scopes() const;
+    // Fragments that frame shaded, negative when they were not counted
+    int64_t fragments() const;
+
+private:
+    // Two go to the frame itself
+    static constexpr uint32_t MAX_QUERIES = 64;
+
+    struct Recorded {
+        const char* name;
+        uint32_t first;
+        uint32_t last;
+        uint32_t depth;
+    };
+
+    struct FrameQueries {
+        uint32_t used = 0;
+        // Open scopes that still have to write their end
+        uint32_t pending = 0;
+        std::vector<Recorded> scopes;
+        // Indices into scopes, SIZE_MAX for one that was dropped
+        std::vector<size_t> open;
+        bool countedFragments = false;
+    };
+
+    uint32_t write(VkCommandBuffer commandBuffer, VkPipelineStageFlagBits stage);
+    void resolve(FrameQueries& frame, uint32_t slot);
+
+    Context& m_context;
+    VkQueryPool m_queryPool;
+    // One fragment count per frame slot, null without pipeline statistics
+    VkQueryPool m_statisticsPool = VK_NULL_HANDLE;
+    // Nanoseconds per tick
+    float m_period;
+    uint64_t m_validMask;
+
+    std::array<FrameQueries, Context::MAX_FRAMES_IN_FLIGHT> m_frames;
+    std::vector<uint64_t> m_timestamps;
+    float m_frameMs = -1.0f;
+    std::vector<Scope> m_scopes;
+    int64_t m_fragments = -1;
+};
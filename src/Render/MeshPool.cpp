@@ -0,0 +1,188 @@
+#include "MeshPool.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "../Trace/Trace.h"
+
+MeshPool::Ranges::Ranges(uint32_t capacity) {
+    m_free[0] = capacity;
+}
+
+bool MeshPool::Ranges::allocate(uint32_t count, uint32_t& first) {
+    for (auto it = m_free.begin(); it != m_free.end(); it++) {
+        if (it->second < count)
+            continue;
+
+        first = it->first;
+        if (it->second > count)
+            m_free[it->first + count] = it->second - count;
+        m_free.erase(it);
+        m_used += count;
+        return true;
+    }
+    return false;
+}
+
+void MeshPool::Ranges::free(uint32_t first, uint32_t count) {
+    m_used -= count;
+    auto it = m_free.emplace(first, count).first;
+
+    auto next = std::next(it);
+    if (next != m_free.end() && it->first + it->second == next->first) {
+        it->second += next->second;
+        m_free.erase(next);
+    }
+    if (it != m_free.begin()) {
+        auto prev = std::prev(it);
+        if (prev->first + prev->second == it->first) {
+            prev->second += it->second;
+            m_free.erase(it);
+        }
+    }
+}
+
+MeshPool::MeshPool(Context& context, uint32_t vertexStride, uint32_t vertexCapacity, uint32_t indexCapacity)
+    : m_context(context), m_vertexStride(vertexStride), m_vertexRanges(vertexCapacity), m_indexRanges(indexCapacity) {
+    // Concurrent so chunk uploads keep going through the transfer queue while the pool is being drawn
+    m_vertices = context.createDeviceBuffer(static_cast<VkDeviceSize>(vertexCapacity) * vertexStride,
+                                            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, true);
+    m_indices = context.createDeviceBuffer(static_cast<VkDeviceSize>(indexCapacity) * sizeof(uint16_t),
+                                           VK_BUFFER_USAGE_INDEX_BUFFER_BIT, true);
+}
+
+MeshPool::~MeshPool() {
+    m_context.release(m_vertices);
+    m_context.release(m_indices);
+    for (auto& frame : m_frames) {
+        m_context.release(frame.commands);
+        m_context.release(frame.origins);
+        m_context.release(frame.bounds);
+    }
+}
+
+MeshPool::Mesh MeshPool::add(const void* vertices, uint32_t vertexCount, const uint16_t* indices, uint32_t indexCount) {
+    TRACE_SCOPE("mesh upload");
+    reclaim();
+
+    Mesh mesh;
+    mesh.vertexCount = vertexCount;
+    mesh.indexCount = indexCount;
+    if (!m_vertexRanges.allocate(vertexCount, mesh.firstVertex))
+        throw std::runtime_error("Mesh pool is out of vertex space!");
+    if (!m_indexRanges.allocate(indexCount, mesh.firstIndex)) {
+        m_vertexRanges.free(mesh.firstVertex, vertexCount);
+        throw std::runtime_error("Mesh pool is out of index space!");
+    }
+
+    m_context.upload(m_vertices, static_cast<VkDeviceSize>(mesh.firstVertex) * m_vertexStride, vertices,
+                     static_cast<VkDeviceSize>(vertexCount) * m_vertexStride);
+    m_context.upload(m_indices, static_cast<VkDeviceSize>(mesh.firstIndex) * sizeof(uint16_t), indices,
+                     static_cast<VkDeviceSize>(indexCount) * sizeof(uint16_t));
+    return mesh;
+}
+
+void MeshPool::remove(const Mesh& mesh) {
+    m_pendingFrees.emplace_back(m_context.frameSerial(), mesh);
+}
+
+void MeshPool::reclaim() {
+    auto completed = m_context.completedSerial();
+    auto retired = std::partition(m_pendingFrees.begin(), m_pendingFrees.end(), [&](auto& free) {
+        return free.first > completed;
+    });
+    for (auto it = retired; it != m_pendingFrees.end(); it++) {
+        m_vertexRanges.free(it->second.firstVertex, it->second.vertexCount);
+        m_indexRanges.free(it->second.firstIndex, it->second.indexCount);
+    }
+    m_pendingFrees.erase(retired, m_pendingFrees.end());
+}
+
+void MeshPool::reserve(FrameDraws& frame, uint32_t count) {
+    auto needed = static_cast<VkDeviceSize>(count) * sizeof(VkDrawIndexedIndirectCommand);
+    if (frame.commands.size >= needed)
+        return;
+
+    // Grow geometrically so a rising draw count settles quickly
+    uint32_t capacity = std::max(count, 1024u);
+    while (capacity < count * 2u)
+        capacity *= 2;
+    m_context.release(frame.commands);
+    m_context.release(frame.origins);
+    m_context.release(frame.bounds);
+    // Storage usage lets a compute pass read them for GPU culling
+    frame.commands = m_context.createHostBuffer(static_cast<VkDeviceSize>(capacity) * sizeof(VkDrawIndexedIndirectCommand),
+                                                VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    frame.origins = m_context.createHostBuffer(static_cast<VkDeviceSize>(capacity) * sizeof(glm::vec3),
+                                               VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+    frame.bounds = m_context.createHostBuffer(static_cast<VkDeviceSize>(capacity) * sizeof(Bounds),
+                                              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+}
+
+void MeshPool::prepare(const std::vector<Draw>& draws) {
+    auto& frame = m_frames[m_context.m_currentFrame];
+    auto count = static_cast<uint32_t>(draws.size());
+    reserve(frame, count);
+    frame.count = count;
+
+    auto commands = static_cast<VkDrawIndexedIndirectCommand*>(frame.commands.memory.mapped);
+    auto origins = static_cast<glm::vec3*>(frame.origins.memory.mapped);
+    auto bounds = static_cast<Bounds*>(frame.bounds.memory.mapped);
+    for (uint32_t i = 0; i < count; i++) {
+        auto& draw = draws[i];
+        commands[i].indexCount = draw.indexCount;
+        commands[i].instanceCount = 1;
+        commands[i].firstIndex = draw.mesh.firstIndex + draw.firstIndex;
+        commands[i].vertexOffset = static_cast<int32_t>(draw.mesh.firstVertex) + draw.vertexOffset;
+        commands[i].firstInstance = i;
+        origins[i] = draw.origin;
+        bounds[i].min = glm::vec4(draw.origin + draw.boundsMin, 1.0f);
+        bounds[i].max = glm::vec4(draw.origin + draw.boundsMax, 1.0f);
+    }
+}
+
+void MeshPool::record(VkCommandBuffer commandBuffer, uint32_t first, uint32_t count) const {
+    auto& frame = m_frames[m_context.m_currentFrame];
+    count = std::min(count, frame.count - std::min(first, frame.count));
+    if (count == 0)
+        return;
+
+    bind(commandBuffer);
+
+    constexpr uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+    auto& features = m_context.m_features;
+    if (!features.drawIndirectFirstInstance) {
+        // Indirect draws cannot pick the origin, direct draws always can
+        auto commands = static_cast<const VkDrawIndexedIndirectCommand*>(frame.commands.memory.mapped);
+        for (uint32_t i = first; i < first + count; i++)
+            vkCmdDrawIndexed(commandBuffer, commands[i].indexCount, 1, commands[i].firstIndex,
+                             commands[i].vertexOffset, commands[i].firstInstance);
+    } else if (!features.multiDrawIndirect) {
+        for (uint32_t i = first; i < first + count; i++)
+            vkCmdDrawIndexedIndirect(commandBuffer, frame.commands.buffer, static_cast<VkDeviceSize>(i) * stride, 1,
+                                     stride);
+    } else {
+        vkCmdDrawIndexedIndirect(commandBuffer, frame.commands.buffer, static_cast<VkDeviceSize>(first) * stride,
+                                 count, stride);
+    }
+}
+
+void MeshPool::bind(VkCommandBuffer commandBuffer) const {
+    auto& frame = m_frames[m_context.m_currentFrame];
+    VkBuffer vertexBuffers[] = {m_vertices.buffer, frame.origins.buffer};
+    VkDeviceSize offsets[] = {0, 0};
+    vkCmdBindVertexBuffers(commandBuffer, 0, 2, vertexBuffers, offsets);
+    vkCmdBindIndexBuffer(commandBuffer, m_indices.buffer, 0, VK_INDEX_TYPE_UINT16);
+}
+
+const MeshPool::FrameDraws& MeshPool::frameDraws() const {
+    return m_frames[m_context.m_currentFrame];
+}
+
+uint32_t MeshPool::vertexCount() const {
+    return m_vertexRanges.used();
+}
+
+uint32_t MeshPool::indexCount() const {
+    return m_indexRanges.used();
+}
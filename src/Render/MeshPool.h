@@ -0,0 +1,96 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "../Context.h"
+
+// Every chunk mesh lives in one shared vertex buffer and one shared index buffer, so a frame's chunks
+// go out as a single vkCmdDrawIndexedIndirect. Each draw's origin is an instance rate attribute,
+// selected through the draw's first instance.
+class MeshPool {
+public:
+    // Where a mesh landed in the shared buffers
+    struct Mesh {
+        uint32_t firstVertex = 0;
+        uint32_t vertexCount = 0;
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+    };
+
+    // Part of a mesh drawn at an origin. Offsets are relative to the mesh, bounds to the origin.
+    struct Draw {
+        Mesh mesh;
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        int32_t vertexOffset;
+        glm::vec3 origin;
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+    };
+
+    // World space box of a prepared draw, laid out for std430 reads
+    struct Bounds {
+        glm::vec4 min;
+        glm::vec4 max;
+    };
+
+    // Host visible so the CPU can write this frame's commands without a copy
+    struct FrameDraws {
+        Context::Buffer commands;
+        Context::Buffer origins;
+        Context::Buffer bounds;
+        uint32_t count = 0;
+    };
+
+    MeshPool(Context& context, uint32_t vertexStride, uint32_t vertexCapacity, uint32_t indexCapacity);
+    ~MeshPool();
+
+    MeshPool(const MeshPool&) = delete;
+    MeshPool& operator=(const MeshPool&) = delete;
+
+    Mesh add(const void* vertices, uint32_t vertexCount, const uint16_t* indices, uint32_t indexCount);
+    // The ranges are reused once no frame in flight can still be drawing them
+    void remove(const Mesh& mesh);
+
+    // Writes the frame's indirect commands and origins, call once per frame before recording
+    void prepare(const std::vector<Draw>& draws);
+    // Binds the shared buffers and draws commands [first, first + count) of the prepared list
+    void record(VkCommandBuffer commandBuffer, uint32_t first, uint32_t count) const;
+    // Binds the shared buffers for drawing commands written elsewhere
+    void bind(VkCommandBuffer commandBuffer) const;
+    // What prepare wrote for the frame being recorded
+    const FrameDraws& frameDraws() const;
+
+    uint32_t vertexCount() const;
+    uint32_t indexCount() const;
+
+private:
+    // First fit over element ranges, neighbours are merged on free
+    class Ranges {
+    public:
+        explicit Ranges(uint32_t capacity);
+        bool allocate(uint32_t count, uint32_t& first);
+        void free(uint32_t first, uint32_t count);
+        uint32_t used() const { return m_used; }
+    private:
+        std::map<uint32_t, uint32_t> m_free;
+        uint32_t m_used = 0;
+    };
+
+    void reclaim();
+    void reserve(FrameDraws& frame, uint32_t count);
+
+    Context& m_context;
+    uint32_t m_vertexStride;
+    Context::Buffer m_vertices;
+    Context::Buffer m_indices;
+    Ranges m_vertexRanges;
+    Ranges m_indexRanges;
+    std::vector<std::pair<uint64_t, Mesh>> m_pendingFrees;
+    std::array<FrameDraws, Context::MAX_FRAMES_IN_FLIGHT> m_frames;
+};
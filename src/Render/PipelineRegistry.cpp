@@ -0,0 +1,380 @@
+#include "PipelineRegistry.h"
+
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+
+#include "../Shader/Shader.h"
+#include "../Vulkan/Pipeline.h"
+
+namespace {
+    template <typename T>
+    void combine(PipelineRegistry::Id& seed, const T& value) {
+        seed ^= std::hash<T>()(value) + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+    }
+}
+
+PipelineRegistry::Id PipelineRegistry::Desc::hash() const {
+    Id seed = 0;
+    combine(seed, vertexShader);
+    combine(seed, fragmentShader);
+    combine(seed, computeShader);
+    combine(seed, static_cast<int>(topology));
+    combine(seed, static_cast<int>(polygonMode));
+    combine(seed, static_cast<uint32_t>(cullMode));
+    combine(seed, depthTest);
+    combine(seed, depthWrite);
+    combine(seed, static_cast<int>(depthCompare));
+    combine(seed, blend);
+    combine(seed, layout);
+    combine(seed, renderPass);
+    combine(seed, subpass);
+    return seed;
+}
+
+bool PipelineRegistry::Desc::operator==(const Desc& other) const {
+    return vertexShader == other.vertexShader && fragmentShader == other.fragmentShader &&
+           computeShader == other.computeShader && topology == other.topology &&
+           polygonMode == other.polygonMode && cullMode == other.cullMode && depthTest == other.depthTest &&
+           depthWrite == other.depthWrite && depthCompare == other.depthCompare && blend == other.blend &&
+           layout == other.layout && renderPass == other.renderPass && subpass == other.subpass;
+}
+
+PipelineRegistry::PipelineRegistry(Context& context, Scheduler& scheduler)
+    : m_context(context), m_scheduler(scheduler) {}
+
+PipelineRegistry::~PipelineRegistry() {
+    m_lazyCompiles.clear();
+    vkDeviceWaitIdle(m_context.m_device);
+    for (auto& entry : m_entries) {
+        vkDestroyPipeline(m_context.m_device, entry.second->pipeline, nullptr);
+        vkDestroyPipeline(m_context.m_device, entry.second->replacement, nullptr);
+    }
+    for (auto& retired : m_retired)
+        vkDestroyPipeline(m_context.m_device, retired.second, nullptr);
+}
+
+PipelineRegistry::Id PipelineRegistry::add(const Desc& desc, bool lazy) {
+    auto id = desc.hash();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto found = m_entries.find(id);
+    if (found != m_entries.end()) {
+        if (!(found->second->desc == desc))
+            throw std::runtime_error("Pipeline state hash collision!");
+        // Something needs it up front after all
+        found->second->lazy &= lazy;
+        return id;
+    }
+
+    auto entry = std::make_unique<Entry>();
+    entry->desc = desc;
+    entry->lazy = lazy;
+    m_entries.emplace(id, std::move(entry));
+    return id;
+}
+
+void PipelineRegistry::compile() {
+    std::vector<Entry*> pending;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& entry : m_entries) {
+            auto idle = State::Idle;
+            if (!entry.second->lazy && entry.second->state.compare_exchange_strong(idle, State::Compiling))
+                pending.push_back(entry.second.get());
+        }
+    }
+    if (pending.empty())
+        return;
+
+    // The pipeline cache is internally synchronized, so every worker can compile into it at once
+    m_context.m_pipelineCache->timed((std::to_string(pending.size()) + " pipelines").c_str(), [&]() {
+        std::vector<Scheduler::Future<void>> futures;
+        for (auto* entry : pending)
+            futures.push_back(m_scheduler.run([this, entry]() { build(*entry); }));
+        // Every build has to finish before unwinding, a second failure in a Future's destructor would terminate
+        std::exception_ptr error;
+        for (auto& future : futures) {
+            try {
+                future.get();
+            } catch (...) {
+                if (!error)
+                    error = std::current_exception();
+            }
+        }
+        if (error)
+            std::rethrow_exception(error);
+    });
+}
+
+VkPipeline PipelineRegistry::get(Id id) const {
+    auto& found = entry(id);
+    if (found.state != State::Ready)
+        throw std::runtime_error("Pipeline was not compiled!");
+    return found.pipeline;
+}
+
+VkPipeline PipelineRegistry::get(Id id, Id fallback) {
+    auto& found = entry(id);
+    auto state = found.state.load();
+    if (state == State::Ready)
+        return found.pipeline;
+
+    if (state == State::Idle && found.state.compare_exchange_strong(state, State::Compiling)) {
+        m_lazyCompiles.push_back(m_scheduler.run([this, &found]() {
+            // Nobody is waiting to rethrow, a variant that fails to build keeps using its fallback
+            try {
+                m_context.m_pipelineCache->timed(found.desc.name.c_str(), [&]() { build(found); });
+            } catch (std::runtime_error& err) {
+                found.state = State::Failed;
+                std::cerr << "Pipeline " << found.desc.name << ": " << err.what() << std::endl;
+            }
+        }));
+    }
+    return get(fallback);
+}
+
+bool PipelineRegistry::ready(Id id) const {
+    return entry(id).state == State::Ready;
+}
+
+void PipelineRegistry::reload(const std::string& shader) {
+    std::vector<Entry*> affected;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& entry : m_entries) {
+            // A rebuild already running picks up the same file, as long as it has not loaded it yet
+            auto& found = *entry.second;
+            if (found.state == State::Ready && found.uses(shader) && !found.rebuilding.exchange(true))
+                affected.push_back(&found);
+        }
+    }
+
+    m_lazyCompiles.erase(std::remove_if(m_lazyCompiles.begin(), m_lazyCompiles.end(), [](auto& compile) {
+        return compile.ready();
+    }), m_lazyCompiles.end());
+    for (auto* entry : affected) {
+        m_lazyCompiles.push_back(m_scheduler.run([this, entry]() {
+            try {
+                m_context.m_pipelineCache->timed(entry->desc.name.c_str(), [&]() {
+                    entry->replacement = create(entry->desc);
+                });
+            } catch (std::runtime_error& err) {
+                entry->rebuilding = false;
+                std::cerr << "Pipeline " << entry->desc.name << ": " << err.what() << ", keeping the old one"
+                          << std::endl;
+            }
+        }));
+    }
+}
+
+void PipelineRegistry::swap() {
+    auto completed = m_context.completedSerial();
+    auto retired = std::partition(m_retired.begin(), m_retired.end(), [&](auto& pipeline) {
+        return pipeline.first > completed;
+    });
+    for (auto it = retired; it != m_retired.end(); it++)
+        vkDestroyPipeline(m_context.m_device, it->second, nullptr);
+    m_retired.erase(retired, m_retired.end());
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& entry : m_entries) {
+        auto replacement = entry.second->replacement.exchange(VK_NULL_HANDLE);
+        if (replacement == VK_NULL_HANDLE)
+            continue;
+        // The last frame submitted is the newest that could have bound the old one
+        m_retired.emplace_back(m_context.frameSerial(), entry.second->pipeline.exchange(replacement));
+        entry.second->rebuilding = false;
+    }
+}
+
+PipelineRegistry::Entry& PipelineRegistry::entry(Id id) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto found = m_entries.find(id);
+    if (found == m_entries.end())
+        throw std::runtime_error("Pipeline is not registered!");
+    return *found->second;
+}
+
+bool PipelineRegistry::Entry::uses(const std::string& shader) const {
+    return desc.vertexShader == shader || desc.fragmentShader == shader || desc.computeShader == shader;
+}
+
+void PipelineRegistry::build(Entry& entry) const {
+    try {
+        entry.pipeline = create(entry.desc);
+    } catch (...) {
+        entry.state = State::Failed;
+        throw;
+    }
+    entry.state = State::Ready;
+}
+
+VkPipeline PipelineRegistry::create(const Desc& desc) const {
+    return desc.computeShader.empty() ? buildGraphics(desc) : buildCompute(desc);
+}
+
+VkPipeline PipelineRegistry::buildGraphics(const Desc& desc) const {
+    Shader vert(m_context.m_device, desc.vertexShader);
+    Shader frag(m_context.m_device, desc.fragmentShader);
+
+    VkPipelineShaderStageCreateInfo vertStageInfo = {};
+    vertStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    vertStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+    vertStageInfo.module = vert.module();
+    vertStageInfo.pName = "main";
+    VkPipelineShaderStageCreateInfo fragStageInfo = {};
+    fragStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    fragStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    fragStageInfo.module = frag.module();
+    fragStageInfo.pName = "main";
+    VkPipelineShaderStageCreateInfo shaderStages[] = {vertStageInfo, fragStageInfo};
+
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
+    VkVertexInputBindingDescription bindingDescriptions[2] = {};
+    bindingDescriptions[0].binding = 0;
+    bindingDescriptions[0].stride = 6 * sizeof(float);
+    bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    // Chunk origin, one per draw, picked by the draw's first instance
+    bindingDescriptions[1].binding = 1;
+    bindingDescriptions[1].stride = 3 * sizeof(float);
+    bindingDescriptions[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+    VkVertexInputAttributeDescription attributeDescriptions[3] = {};
+    attributeDescriptions[0].binding = 0;
+    attributeDescriptions[0].location = 0;
+    attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+    attributeDescriptions[0].offset = 0;
+
+    attributeDescriptions[1].binding = 0;
+    attributeDescriptions[1].location = 1;
+    attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+    attributeDescriptions[1].offset = 3 * sizeof(float);
+
+    attributeDescriptions[2].binding = 1;
+    attributeDescriptions[2].location = 2;
+    attributeDescriptions[2].format = VK_FORMAT_R32G32B32_SFLOAT;
+    attributeDescriptions[2].offset = 0;
+
+    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInputInfo.vertexBindingDescriptionCount = 2;
+    vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions;
+    vertexInputInfo.vertexAttributeDescriptionCount = 3;
+    vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions;
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo = {};
+    inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssemblyInfo.topology = desc.topology;
+    inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
+
+    VkViewport viewport = {};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = static_cast<float>(m_context.m_swapChainExtent.width);
+    viewport.height = static_cast<float>(m_context.m_swapChainExtent.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+
+    VkRect2D scissor = {};
+    scissor.offset = {0, 0};
+    scissor.extent = m_context.m_swapChainExtent;
+
+    VkPipelineViewportStateCreateInfo viewportStateInfo = {};
+    viewportStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportStateInfo.viewportCount = 1;
+    viewportStateInfo.pViewports = &viewport;
+    viewportStateInfo.scissorCount = 1;
+    viewportStateInfo.pScissors = &scissor;
+
+    VkPipelineRasterizationStateCreateInfo rasterizationStateInfo = {};
+    rasterizationStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizationStateInfo.depthClampEnable = VK_FALSE;
+    rasterizationStateInfo.rasterizerDiscardEnable = VK_FALSE;
+    rasterizationStateInfo.polygonMode = desc.polygonMode;
+    rasterizationStateInfo.lineWidth = 1.0f;
+    rasterizationStateInfo.cullMode = desc.cullMode;
+    rasterizationStateInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    rasterizationStateInfo.depthBiasEnable = VK_FALSE;
+    rasterizationStateInfo.depthBiasConstantFactor = 0.0f;
+    rasterizationStateInfo.depthBiasClamp = 0.0f;
+    rasterizationStateInfo.depthBiasSlopeFactor = 0.0f;
+
+    VkPipelineMultisampleStateCreateInfo multisampleStateInfo = {};
+    multisampleStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampleStateInfo.sampleShadingEnable = VK_FALSE;
+    multisampleStateInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    multisampleStateInfo.minSampleShading = 1.0f;
+    multisampleStateInfo.pSampleMask = nullptr;
+    multisampleStateInfo.alphaToCoverageEnable = VK_FALSE;
+    multisampleStateInfo.alphaToOneEnable = VK_FALSE;
+
+    VkPipelineDepthStencilStateCreateInfo depthStencilInfo = {};
+    depthStencilInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencilInfo.depthTestEnable = desc.depthTest ? VK_TRUE : VK_FALSE;
+    depthStencilInfo.depthWriteEnable = desc.depthWrite ? VK_TRUE : VK_FALSE;
+    depthStencilInfo.depthCompareOp = desc.depthCompare;
+    depthStencilInfo.depthBoundsTestEnable = VK_FALSE;
+    depthStencilInfo.stencilTestEnable = VK_FALSE;
+    depthStencilInfo.minDepthBounds = 0.0f;
+    depthStencilInfo.maxDepthBounds = 1.0f;
+
+    VkPipelineColorBlendAttachmentState colorBlendState = {};
+    colorBlendState.colorWriteMask =
+        VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    colorBlendState.blendEnable = desc.blend ? VK_TRUE : VK_FALSE;
+    colorBlendState.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    colorBlendState.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    colorBlendState.colorBlendOp = VK_BLEND_OP_ADD;
+    colorBlendState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    colorBlendState.alphaBlendOp = VK_BLEND_OP_ADD;
+
+    VkPipelineColorBlendStateCreateInfo colorBlendStateInfo = {};
+    colorBlendStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlendStateInfo.logicOpEnable = VK_FALSE;
+    colorBlendStateInfo.logicOp = VK_LOGIC_OP_COPY;
+    colorBlendStateInfo.attachmentCount = 1;
+    colorBlendStateInfo.pAttachments = &colorBlendState;
+    colorBlendStateInfo.blendConstants[0] = 0.0f;
+    colorBlendStateInfo.blendConstants[1] = 0.0f;
+    colorBlendStateInfo.blendConstants[2] = 0.0f;
+    colorBlendStateInfo.blendConstants[3] = 0.0f;
+
+    VkGraphicsPipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount = 2;
+    pipelineInfo.pStages = shaderStages;
+    pipelineInfo.pVertexInputState = &vertexInputInfo;
+    pipelineInfo.pInputAssemblyState = &inputAssemblyInfo;
+    pipelineInfo.pViewportState = &viewportStateInfo;
+    pipelineInfo.pRasterizationState = &rasterizationStateInfo;
+    pipelineInfo.pMultisampleState = &multisampleStateInfo;
+    // The render pass has a depth attachment, so the state is needed even with the test off
+    pipelineInfo.pDepthStencilState = &depthStencilInfo;
+    pipelineInfo.pColorBlendState = &colorBlendStateInfo;
+    pipelineInfo.pDynamicState = nullptr;
+    pipelineInfo.layout = desc.layout;
+    pipelineInfo.renderPass = desc.renderPass;
+    pipelineInfo.subpass = desc.subpass;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineInfo.basePipelineIndex = -1;
+
+    VkPipeline pipeline;
+    if (vkCreateGraphicsPipelines(m_context.m_device, m_context.m_pipelineCache->handle(), 1, &pipelineInfo, nullptr,
+                                  &pipeline) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create graphics pipeline!");
+    return pipeline;
+}
+
+VkPipeline PipelineRegistry::buildCompute(const Desc& desc) const {
+    Shader shader(m_context.m_device, desc.computeShader);
+    vk::ComputePipelineInfo info(shader.module(), desc.layout);
+
+    VkPipeline pipeline;
+    if (vkCreateComputePipelines(m_context.m_device, m_context.m_pipelineCache->handle(), 1, &info, nullptr,
+                                 &pipeline) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create compute pipeline!");
+    return pipeline;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "../Context.h"
+#include "../Threads/Scheduler.h"
+
+// Every pipeline the renderer binds, described by its state and keyed by a hash of it, so asking for the
+// same state twice hands back the same pipeline. Pipelines needed up front are compiled together on the
+// scheduler's workers, rare variants compile in the background the first time they are asked for.
+class PipelineRegistry {
+public:
+    using Id = uint64_t;
+
+    // Everything that goes into a pipeline. A compute shader makes it a compute pipeline and the graphics
+    // state is ignored. Graphics pipelines take the chunk vertex layout and the swap chain's viewport.
+    struct Desc {
+        // Only for logging, not part of the state
+        std::string name;
+
+        std::string vertexShader;
+        std::string fragmentShader;
+        std::string computeShader;
+
+        VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+        VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+        bool depthTest = false;
+        bool depthWrite = false;
+        VkCompareOp depthCompare = VK_COMPARE_OP_LESS;
+        bool blend = true;
+
+        VkPipelineLayout layout = VK_NULL_HANDLE;
+        VkRenderPass renderPass = VK_NULL_HANDLE;
+        uint32_t subpass = 0;
+
+        Id hash() const;
+        bool operator==(const Desc& other) const;
+    };
+
+    PipelineRegistry(Context& context, Scheduler& scheduler);
+    ~PipelineRegistry();
+
+    PipelineRegistry(const PipelineRegistry&) = delete;
+    PipelineRegistry& operator=(const PipelineRegistry&) = delete;
+
+    // Registers the state, or finds it when it is already registered. Lazy pipelines are left out of
+    // compile() and only built once something asks for them.
+    Id add(const Desc& desc, bool lazy = false);
+
+    // Compiles every registered pipeline that is not lazy or built yet in parallel, and waits for them
+    void compile();
+
+    // The pipeline, which has to have been compiled already
+    VkPipeline get(Id id) const;
+    // The pipeline once it is ready, fallback until then. The first call starts compiling it in the background.
+    VkPipeline get(Id id, Id fallback);
+
+    bool ready(Id id) const;
+
+    // Rebuilds every compiled pipeline that loads the shader in the background, the old one stays bound meanwhile
+    void reload(const std::string& shader);
+    // Swaps in rebuilt pipelines, between frames. The ones they replace go once no frame in flight uses them.
+    void swap();
+
+private:
+    enum class State { Idle, Compiling, Ready, Failed };
+
+    struct Entry {
+        Desc desc;
+        bool lazy = false;
+        std::atomic<State> state{State::Idle};
+        std::atomic<VkPipeline> pipeline{VK_NULL_HANDLE};
+        // Set by a reload when its rebuild finishes, taken by swap
+        std::atomic<VkPipeline> replacement{VK_NULL_HANDLE};
+        std::atomic<bool> rebuilding{false};
+
+        bool uses(const std::string& shader) const;
+    };
+
+    Entry& entry(Id id) const;
+    // Creates the entry's pipeline on the calling thread
+    void build(Entry& entry) const;
+    VkPipeline create(const Desc& desc) const;
+    VkPipeline buildGraphics(const Desc& desc) const;
+    VkPipeline buildCompute(const Desc& desc) const;
+
+    Context& m_context;
+    Scheduler& m_scheduler;
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<Id, std::unique_ptr<Entry>> m_entries;
+    // Background compiles, held so they are waited for before the registry goes away
+    std::vector<Scheduler::Future<void>> m_lazyCompiles;
+    // Pipelines replaced by a reload, with the last frame serial that could have bound them
+    std::vector<std::pair<uint64_t, VkPipeline>> m_retired;
+};
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+// A SPIR-V module in memory, size in bytes
+struct ShaderCode {
+    const uint32_t* words;
+    size_t size;
+};
+
+// Modules compiled into the binary, keyed by the path they would otherwise be loaded from. The definition
+// is generated by CMake from the shader sources.
+const std::unordered_map<std::string, ShaderCode>& embeddedShaders();
@@ -1,37 +1,101 @@
 #include "Shader.h"
 
+#include <map>
+#include <mutex>
+#include <stdexcept>
 #include <vector>
 #include <fstream>
 
-namespace {
-    std::vector<char> readFile(const std::string& fileName) {
-        std::ifstream file(fileName, std::ios::ate | std::ios::binary);
-        if (!file.is_open())
-            throw std::runtime_error("Failed to open file!");
+#ifdef __unix__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
-        auto fileSize = static_cast<size_t>(file.tellg());
-        std::vector<char> buffer(fileSize);
+#include "EmbeddedShaders.h"
 
-        file.seekg(0);
-        file.read(buffer.data(), fileSize);
+namespace {
+    std::mutex overrideMutex;
+    std::map<std::string, std::string> overrides;
 
-        file.close();
-        return buffer;
+    // Where fileName is rebuilt to, empty when it never was
+    std::string overridePath(const std::string& fileName) {
+        std::lock_guard<std::mutex> lock(overrideMutex);
+        auto found = overrides.find(fileName);
+        return found != overrides.end() ? found->second : std::string();
     }
+
+    // A module file mapped read only. Mappings are page aligned, so the words can be handed over as they are.
+    class MappedFile {
+    public:
+        explicit MappedFile(const std::string& fileName) {
+#ifdef __unix__
+            int fd = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+                throw std::runtime_error("Failed to open file!");
+
+            struct stat info = {};
+            if (fstat(fd, &info) == 0 && info.st_size > 0) {
+                m_size = static_cast<size_t>(info.st_size);
+                void* mapped = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                m_data = mapped == MAP_FAILED ? nullptr : static_cast<const uint32_t*>(mapped);
+            }
+            close(fd);
+            if (!m_data)
+                throw std::runtime_error("Failed to map file!");
+#else
+            std::ifstream file(fileName, std::ios::ate | std::ios::binary);
+            if (!file.is_open())
+                throw std::runtime_error("Failed to open file!");
+
+            // Read into words rather than chars, so the code is aligned for the driver
+            m_size = static_cast<size_t>(file.tellg());
+            m_words.resize((m_size + 3) / 4);
+            file.seekg(0);
+            file.read(reinterpret_cast<char*>(m_words.data()), m_size);
+            m_data = m_words.data();
+#endif
+        }
+
+        ~MappedFile() {
+#ifdef __unix__
+            munmap(const_cast<uint32_t*>(m_data), m_size);
+#endif
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const uint32_t* data() const { return m_data; }
+        size_t size() const { return m_size; }
+
+    private:
+        const uint32_t* m_data = nullptr;
+        size_t m_size = 0;
+        std::vector<uint32_t> m_words;
+    };
 }
 
 Shader::Shader(VkDevice& device, const std::string& fileName) {
     m_device = device;
 
-    auto code = readFile(fileName);
+    auto path = overridePath(fileName);
+    if (!path.empty()) {
+        MappedFile file(path);
+        create(file.data(), file.size());
+        return;
+    }
 
-    VkShaderModuleCreateInfo createInfo = {};
-    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    createInfo.codeSize = code.size();
-    createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+    auto& embedded = embeddedShaders();
+    auto found = embedded.find(fileName);
+    if (found != embedded.end()) {
+        create(found->second.words, found->second.size);
+        return;
+    }
 
-    if (vkCreateShaderModule(m_device, &createInfo, nullptr, &m_module) != VK_SUCCESS)
-        throw std::runtime_error("Failed to create shader module!");
+    MappedFile file(fileName);
+    create(file.data(), file.size());
 }
 
 Shader::~Shader() {
@@ -42,4 +106,20 @@ VkShaderModule Shader::module() {
     return m_module;
 }
 
+void Shader::overrideFromDisk(const std::string& fileName, const std::string& path) {
+    std::lock_guard<std::mutex> lock(overrideMutex);
+    overrides[fileName] = path;
+}
+
+void Shader::create(const uint32_t* code, size_t size) {
+    if (size == 0 || size % sizeof(uint32_t) != 0)
+        throw std::runtime_error("Invalid SPIR-V module!");
 
+    VkShaderModuleCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    createInfo.codeSize = size;
+    createInfo.pCode = code;
+
+    if (vkCreateShaderModule(m_device, &createInfo, nullptr, &m_module) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create shader module!");
+}
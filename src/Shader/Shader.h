@@ -7,15 +7,19 @@
 class Shader {
 public:
     Shader() = default;
+    // Uses the module built into the binary under fileName, and only reads the file when there is none.
+    // An overridden module is read from where it was rebuilt to instead.
     Shader(VkDevice& device, const std::string& fileName);
     ~Shader();
 
     VkShaderModule module();
 
+    // Loads fileName from path from now on, for modules rebuilt while running
+    static void overrideFromDisk(const std::string& fileName, const std::string& path);
+
 private:
+    void create(const uint32_t* code, size_t size);
 
     VkDevice m_device;
     VkShaderModule m_module;
 };
-
-
@@ -0,0 +1,140 @@
+#include "ShaderWatcher.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <iostream>
+#include <set>
+
+#ifdef __linux__
+#include <spawn.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+#endif
+
+#include "Shader.h"
+
+namespace {
+    bool isSource(const std::string& name) {
+        for (auto extension : {".vert", ".frag", ".comp"}) {
+            auto length = std::char_traits<char>::length(extension);
+            if (name.size() > length && name.compare(name.size() - length, length, extension) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    // Runs a program with the given arguments and waits for it. No shell is involved, so file names are
+    // passed through as they are.
+    bool run(const std::vector<std::string>& args) {
+#ifdef __linux__
+        std::vector<char*> argv;
+        for (auto& arg : args)
+            argv.push_back(const_cast<char*>(arg.c_str()));
+        argv.push_back(nullptr);
+
+        pid_t pid;
+        if (posix_spawnp(&pid, argv[0], nullptr, nullptr, argv.data(), environ) != 0)
+            return false;
+        int status = 0;
+        while (waitpid(pid, &status, 0) < 0) {
+            if (errno != EINTR)
+                return false;
+        }
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#else
+        return false;
+#endif
+    }
+}
+
+ShaderWatcher::ShaderWatcher(Scheduler& scheduler, std::string directory, std::string outputDirectory)
+    : m_scheduler(scheduler), m_directory(std::move(directory)), m_outputDirectory(std::move(outputDirectory)) {
+#ifdef __linux__
+    if (mkdir(m_outputDirectory.c_str(), 0755) < 0 && errno != EEXIST) {
+        std::cerr << "Not watching " << m_directory << " for shader changes, cannot create "
+                  << m_outputDirectory << std::endl;
+        return;
+    }
+
+    // Editors either write the file in place or write a new one and rename it over
+    m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_fd >= 0 && inotify_add_watch(m_fd, m_directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        std::cerr << "Not watching " << m_directory << " for shader changes" << std::endl;
+        close(m_fd);
+        m_fd = -1;
+    }
+#endif
+}
+
+ShaderWatcher::~ShaderWatcher() {
+    m_compiles.clear();
+#ifdef __linux__
+    if (m_fd >= 0)
+        close(m_fd);
+#endif
+}
+
+std::vector<std::string> ShaderWatcher::poll() {
+#ifdef __linux__
+    if (m_fd >= 0) {
+        // One save can raise several events, compile each source once
+        std::set<std::string> changed;
+        alignas(inotify_event) char buffer[4096];
+        ssize_t length;
+        while ((length = read(m_fd, buffer, sizeof(buffer))) > 0) {
+            for (ssize_t offset = 0; offset < length;) {
+                auto event = reinterpret_cast<const inotify_event*>(buffer + offset);
+                if (event->len > 0 && isSource(event->name))
+                    changed.insert(event->name);
+                offset += sizeof(inotify_event) + event->len;
+            }
+        }
+        for (auto& source : changed)
+            compile(source);
+    }
+#endif
+
+    m_compiles.erase(std::remove_if(m_compiles.begin(), m_compiles.end(), [](auto& compile) {
+        return compile.ready();
+    }), m_compiles.end());
+
+    std::vector<std::string> compiled;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    compiled.swap(m_compiled);
+    return compiled;
+}
+
+std::string ShaderWatcher::spirvName(const std::string& source) {
+    auto dot = source.rfind('.');
+    auto name = source.substr(0, dot);
+    if (name == "shader")
+        return source.substr(dot + 1) + ".spv";
+    return name + ".spv";
+}
+
+void ShaderWatcher::compile(const std::string& source) {
+    m_compiles.push_back(m_scheduler.run([this, source]() {
+        auto input = m_directory + "/" + source;
+        auto name = m_directory + "/" + spirvName(source);
+        auto output = m_outputDirectory + "/" + spirvName(source);
+        auto partial = output + ".tmp";
+
+        // Written next to the last rebuild and renamed over it, so a pipeline never loads half a file
+        if (!run({"glslangValidator", "-V", input, "-o", partial}) ||
+            std::rename(partial.c_str(), output.c_str()) != 0) {
+            std::remove(partial.c_str());
+            std::cerr << "Failed to compile " << input << ", keeping the last good module" << std::endl;
+            return;
+        }
+
+        // Both the module built into the binary and the checked in one are older than this one now
+        Shader::overrideFromDisk(name, output);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_compiled.push_back(name);
+    }));
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../Threads/Scheduler.h"
+
+// Watches a directory of GLSL sources and recompiles any that change with glslangValidator on the
+// scheduler's workers. Rebuilt modules go to the output directory, the checked in ones are left alone.
+// Only implemented with inotify, elsewhere it never reports anything.
+class ShaderWatcher {
+public:
+    ShaderWatcher(Scheduler& scheduler, std::string directory, std::string outputDirectory);
+    ~ShaderWatcher();
+
+    ShaderWatcher(const ShaderWatcher&) = delete;
+    ShaderWatcher& operator=(const ShaderWatcher&) = delete;
+
+    // Starts compiles for sources changed since the last call, and returns the SPIR-V files that finished,
+    // named the way pipelines load them
+    std::vector<std::string> poll();
+
+    // Output file for a source, the same as Shaders/build.sh: shader.<stage> keeps glslangValidator's
+    // default of <stage>.spv, anything else becomes <name>.spv
+    static std::string spirvName(const std::string& source);
+
+private:
+    void compile(const std::string& source);
+
+    Scheduler& m_scheduler;
+    std::string m_directory;
+    std::string m_outputDirectory;
+    int m_fd = -1;
+
+    std::mutex m_mutex;
+    std::vector<std::string> m_compiled;
+    std::vector<Scheduler::Future<void>> m_compiles;
+};
@@ -2,16 +2,21 @@
 
 #include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
 #include <functional>
 #include <future>
 #include <memory>
+#include <mutex>
 #include <thread>
+#include <string>
 #include <type_traits>
 #include <utility>
 #include <vector>
 
 #include "concurrentqueue.h"
+#include "../Trace/Trace.h"
 
 class Scheduler {
 private:
@@ -42,6 +47,8 @@ public:
         Future& operator=(Future&& other) = default;
 
         auto get() { return m_future.get(); }
+        // Whether get() would return without blocking
+        bool ready() const { return m_future.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }
     private:
         std::future<T> m_future;
     };
@@ -51,7 +58,7 @@ public:
     explicit Scheduler(const std::uint32_t numThreads) : m_numThreads(numThreads) {
         try {
             for (auto i = 0; i < numThreads; i++)
-                m_threads.emplace_back(&Scheduler::worker, this);
+                m_threads.emplace_back(&Scheduler::worker, this, i);
         } catch (...) {
             cleanup();
             throw;
@@ -71,6 +78,7 @@ public:
         Packaged job{std::move(bound)};
         Future<ResultType> result{job.get_future()};
         m_jobQueue.enqueue(std::make_unique<Job<Packaged>>(std::move(job)));
+        wake();
         return result;
     }
 
@@ -101,21 +109,37 @@ public:
     }
 
 private:
-    void worker() {
-        return;
+    void worker(int index) {
+        TRACE_THREAD("worker " + std::to_string(index));
         while (m_running) {
             std::unique_ptr<IJob> job;
             if (m_jobQueue.try_dequeue(job)) {
                 m_activeJobs++;
-                job->execute();
+                {
+                    TRACE_SCOPE("job");
+                    job->execute();
+                }
                 m_activeJobs--;
+            } else {
+                // Sleep rather than spin when there is nothing to do, an idle worker shouldn't hold a core
+                std::unique_lock<std::mutex> lock(m_idleMutex);
+                m_idle.wait(lock, [this]() { return !m_running || m_jobQueue.size_approx() > 0; });
             }
-            //std::this_thread::sleep_for(std::chrono::milliseconds(1));
         }
     }
 
+    void wake() {
+        // Taking the lock orders this after a worker that found the queue empty has started waiting
+        { std::lock_guard<std::mutex> lock(m_idleMutex); }
+        m_idle.notify_one();
+    }
+
     void cleanup() {
-        m_running = false;
+        {
+            std::lock_guard<std::mutex> lock(m_idleMutex);
+            m_running = false;
+        }
+        m_idle.notify_all();
         for (auto& thread : m_threads)
             if (thread.joinable())
                 thread.join();
@@ -126,5 +150,7 @@ private:
     std::atomic_bool m_running = true;
     std::atomic_int m_activeJobs = 0;
     moodycamel::ConcurrentQueue<std::unique_ptr<IJob>> m_jobQueue;
+    std::mutex m_idleMutex;
+    std::condition_variable m_idle;
     std::vector<std::thread> m_threads{};
 };
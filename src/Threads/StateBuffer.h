@@ -0,0 +1,48 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+
+// Hands simulation state over to the render thread. The simulation fills in back() and publishes it
+// at the end of each tick; the renderer reads the last two published states and interpolates between them.
+template <typename T>
+class StateBuffer {
+public:
+    explicit StateBuffer(float timestep) : m_timestep(timestep) {}
+
+    StateBuffer(const StateBuffer& rhs) = delete;
+    StateBuffer& operator=(const StateBuffer& rhs) = delete;
+
+    T& back() {
+        return m_back;
+    }
+
+    void publish() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_previous = m_published ? std::move(m_current) : m_back;
+        m_current = m_back;
+        m_published = true;
+        m_publishTime = std::chrono::steady_clock::now();
+    }
+
+    // Returns how far the current time is from previous towards current, in [0, 1]
+    float read(T& previous, T& current) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        previous = m_previous;
+        current = m_current;
+
+        float elapsed = std::chrono::duration<float>(std::chrono::steady_clock::now() - m_publishTime).count();
+        return std::min(elapsed / m_timestep, 1.0f);
+    }
+
+private:
+    float m_timestep;
+
+    mutable std::mutex m_mutex;
+    T m_back{};
+    T m_previous{};
+    T m_current{};
+    bool m_published = false;
+    std::chrono::steady_clock::time_point m_publishTime = std::chrono::steady_clock::now();
+};
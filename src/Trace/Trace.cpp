@@ -0,0 +1,121 @@
+#include "Trace.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace trace {
+    namespace {
+        struct Event {
+            const char* name;
+            uint64_t begin;
+            uint64_t end;
+            uint64_t frame;
+        };
+
+        // Written only by its thread. head counts every scope ever recorded, the ring keeps the last CAPACITY.
+        struct ThreadBuffer {
+            static constexpr uint64_t CAPACITY = 1 << 15;
+
+            uint32_t id;
+            std::string name;
+            std::vector<Event> events = std::vector<Event>(CAPACITY);
+            std::atomic<uint64_t> head{0};
+        };
+
+        std::atomic<uint64_t> g_frame{0};
+        // Ticks and clock time at start(), to scale ticks by when writing
+        std::atomic<uint64_t> g_start{0};
+        std::atomic<uint64_t> g_startNs{0};
+
+        // Buffers outlive their threads, so scopes from finished jobs still make it into the trace
+        std::mutex g_buffersMutex;
+        std::vector<std::unique_ptr<ThreadBuffer>> g_buffers;
+
+        ThreadBuffer& threadBuffer() {
+            thread_local ThreadBuffer* buffer = nullptr;
+            if (!buffer) {
+                std::lock_guard<std::mutex> lock(g_buffersMutex);
+                g_buffers.push_back(std::make_unique<ThreadBuffer>());
+                buffer = g_buffers.back().get();
+                buffer->id = static_cast<uint32_t>(g_buffers.size());
+                buffer->name = "thread " + std::to_string(buffer->id);
+            }
+            return *buffer;
+        }
+    }
+
+    namespace detail {
+        std::atomic<bool> g_enabled{false};
+
+        void record(const char* name, uint64_t begin, uint64_t end) {
+            auto& buffer = threadBuffer();
+            auto head = buffer.head.load(std::memory_order_relaxed);
+            buffer.events[head % ThreadBuffer::CAPACITY] = {name, begin, end, g_frame.load(std::memory_order_relaxed)};
+            buffer.head.store(head + 1, std::memory_order_release);
+        }
+    }
+
+    void start() {
+        g_startNs = detail::clockNs();
+        g_start = detail::now();
+        detail::g_enabled = true;
+    }
+
+    void stop() {
+        detail::g_enabled = false;
+    }
+
+    void markFrame(uint64_t frame) {
+        g_frame.store(frame, std::memory_order_relaxed);
+    }
+
+    void setThreadName(const std::string& name) {
+        auto& buffer = threadBuffer();
+        std::lock_guard<std::mutex> lock(g_buffersMutex);
+        buffer.name = name;
+    }
+
+    void write(const std::string& path) {
+        std::ofstream file(path);
+        if (!file.is_open())
+            throw std::runtime_error("Failed to open trace file!");
+
+        auto start = g_start.load();
+        auto ticks = detail::now() - start;
+        auto elapsedNs = detail::clockNs() - g_startNs.load();
+        double usPerTick = ticks > 0 ? elapsedNs / 1000.0 / static_cast<double>(ticks) : 0.0;
+        bool first = true;
+        auto separator = [&]() -> const char* {
+            const char* text = first ? "\n" : ",\n";
+            first = false;
+            return text;
+        };
+
+        // Timestamps are in microseconds, kept to the nanosecond
+        file << std::fixed << std::setprecision(3);
+        file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+        std::lock_guard<std::mutex> lock(g_buffersMutex);
+        for (auto& buffer : g_buffers) {
+            file << separator() << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << buffer->id
+                 << ", \"args\": {\"name\": \"" << buffer->name << "\"}}";
+
+            auto head = buffer->head.load(std::memory_order_acquire);
+            auto oldest = head > ThreadBuffer::CAPACITY ? head - ThreadBuffer::CAPACITY : 0;
+            for (auto i = oldest; i < head; i++) {
+                auto& event = buffer->events[i % ThreadBuffer::CAPACITY];
+                if (event.end < start)
+                    continue;
+                auto begin = std::max(event.begin, start);
+                file << separator() << "{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": "
+                     << buffer->id << ", \"ts\": " << (begin - start) * usPerTick << ", \"dur\": "
+                     << (event.end - begin) * usPerTick << ", \"args\": {\"frame\": " << event.frame << "}}";
+            }
+        }
+        file << "\n]}\n";
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TRACE_TSC
+#include <x86intrin.h>
+#elif defined(_M_X64)
+#define TRACE_TSC
+#include <intrin.h>
+#endif
+
+// Scoped CPU trace points. Each thread records into its own ring, so a scope never takes a lock, and
+// the rings are written out on demand as Chrome trace_event JSON, which chrome://tracing and Perfetto
+// both open. Scopes are tagged with the frame they began in. While recording is off a scope costs one
+// relaxed load, without ENABLE_TRACING the macros compile to nothing.
+//
+// On x86 scopes are timed with the TSC, which is several times cheaper to read than the OS clock, and
+// converted to wall time against steady_clock between start() and write().
+namespace trace {
+    namespace detail {
+        extern std::atomic<bool> g_enabled;
+
+        inline uint64_t clockNs() {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count());
+        }
+
+        // Timestamps in ticks, nanoseconds where there is no TSC
+        inline uint64_t now() {
+#ifdef TRACE_TSC
+            return __rdtsc();
+#else
+            return clockNs();
+#endif
+        }
+
+        void record(const char* name, uint64_t begin, uint64_t end);
+    }
+
+    // Only scopes that end after start() are written
+    void start();
+    void stop();
+
+    inline bool enabled() {
+        return detail::g_enabled.load(std::memory_order_relaxed);
+    }
+
+    // Scopes that begin after this are tagged with the frame
+    void markFrame(uint64_t frame);
+    // Shown for the calling thread's track
+    void setThreadName(const std::string& name);
+
+    // Writes what is left in every thread's ring since start(), a full ring has overwritten its oldest
+    // scopes. Call it after stop(), rings still being written to can tear.
+    void write(const std::string& path);
+
+    class Scope {
+    public:
+        // The name is kept as a pointer, so it has to be a literal or outlive the trace
+        explicit Scope(const char* name) : m_name(enabled() ? name : nullptr) {
+            if (m_name)
+                m_begin = detail::now();
+        }
+
+        ~Scope() {
+            if (m_name)
+                detail::record(m_name, m_begin, detail::now());
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        const char* m_name;
+        uint64_t m_begin = 0;
+    };
+}
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#ifdef ENABLE_TRACING
+#define TRACE_SCOPE(name) trace::Scope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_FRAME(frame) trace::markFrame(frame)
+#define TRACE_THREAD(name) trace::setThreadName(name)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_FRAME(frame) ((void)0)
+#define TRACE_THREAD(name) ((void)0)
+#endif
@@ -0,0 +1,265 @@
+#include "Allocator.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace vk;
+
+Allocator::Allocator(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize blockSize)
+    : m_device(device), m_blockSize(blockSize), m_levels(0) {
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &m_properties);
+    m_blocks.resize(m_properties.memoryTypeCount);
+
+    for (auto size = m_blockSize; size > MIN_ALLOCATION; size >>= 1)
+        m_levels++;
+    m_levels++;
+}
+
+Allocator::~Allocator() {
+    for (auto& blocks : m_blocks)
+        for (auto& block : blocks)
+            if (block)
+                vkFreeMemory(m_device, block->memory, nullptr);
+}
+
+uint32_t Allocator::findMemoryType(uint32_t filter, VkMemoryPropertyFlags flags) const {
+    for (uint32_t i = 0; i < m_properties.memoryTypeCount; i++)
+        if (filter & (1 << i) && (m_properties.memoryTypes[i].propertyFlags & flags) == flags)
+            return i;
+
+    throw std::runtime_error("Failed to find memory type!");
+}
+
+Allocation Allocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags flags, void* userData) {
+    uint32_t memoryType = findMemoryType(requirements.memoryTypeBits, flags);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (requirements.size >= m_blockSize / 2 || requirements.alignment > m_blockSize)
+        return allocateDedicated(requirements.size, memoryType);
+
+    // Buddy nodes are aligned to their own size, so rounding up covers the alignment too
+    uint32_t level = levelFor(requirements.size, requirements.alignment);
+    auto& blocks = m_blocks[memoryType];
+
+    VkDeviceSize offset;
+    for (uint32_t i = 0; i < blocks.size(); i++)
+        if (blocks[i] && allocateFrom(*blocks[i], level, requirements.size, userData, offset))
+            return place(memoryType, i, offset, requirements.size);
+
+    uint32_t index = createBlock(memoryType);
+    allocateFrom(*blocks[index], level, requirements.size, userData, offset);
+    return place(memoryType, index, offset, requirements.size);
+}
+
+void Allocator::free(Allocation& allocation) {
+    if (allocation.memory == VK_NULL_HANDLE)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (allocation.block == Allocation::DEDICATED) {
+        vkFreeMemory(m_device, allocation.memory, nullptr);
+        m_dedicatedCount--;
+        m_dedicatedBytes -= allocation.size;
+    } else {
+        freeIn(*m_blocks[allocation.memoryType][allocation.block], allocation.offset);
+    }
+
+    allocation = {};
+}
+
+std::vector<Allocator::Relocation> Allocator::defragment(VkDeviceSize maxBytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<Relocation> relocations;
+    VkDeviceSize moved = 0;
+
+    for (uint32_t type = 0; type < m_blocks.size(); type++) {
+        auto& blocks = m_blocks[type];
+
+        // Empty the least used blocks first, moving into the fullest ones
+        std::vector<uint32_t> order;
+        for (uint32_t i = 0; i < blocks.size(); i++)
+            if (blocks[i] && !blocks[i]->used.empty())
+                order.push_back(i);
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            return blocks[a]->usedBytes < blocks[b]->usedBytes;
+        });
+
+        for (size_t source = 0; source < order.size(); source++) {
+            auto& from = *blocks[order[source]];
+            std::vector<std::pair<VkDeviceSize, Block::Node>> nodes(from.used.begin(), from.used.end());
+
+            for (auto& [offset, node] : nodes) {
+                if (moved + node.size > maxBytes)
+                    return relocations;
+
+                for (size_t target = order.size(); target-- > source + 1;) {
+                    auto& to = *blocks[order[target]];
+                    VkDeviceSize newOffset;
+                    if (!allocateFrom(to, node.level, node.size, node.userData, newOffset))
+                        continue;
+
+                    relocations.push_back({place(type, order[source], offset, node.size),
+                                           place(type, order[target], newOffset, node.size),
+                                           node.userData});
+                    moved += node.size;
+                    break;
+                }
+            }
+        }
+    }
+
+    return relocations;
+}
+
+void Allocator::releaseEmptyBlocks() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& blocks : m_blocks) {
+        for (auto& block : blocks) {
+            if (block && block->used.empty()) {
+                vkFreeMemory(m_device, block->memory, nullptr);
+                block.reset();
+            }
+        }
+    }
+}
+
+Allocator::Stats Allocator::stats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats stats;
+    stats.dedicated = m_dedicatedCount;
+    stats.allocations = m_dedicatedCount;
+    stats.reserved = m_dedicatedBytes;
+    stats.used = m_dedicatedBytes;
+
+    for (auto& blocks : m_blocks) {
+        for (auto& block : blocks) {
+            if (!block)
+                continue;
+
+            stats.blocks++;
+            stats.allocations += static_cast<uint32_t>(block->used.size());
+            stats.reserved += m_blockSize;
+            stats.used += block->usedBytes;
+            for (uint32_t level = 0; level < m_levels; level++) {
+                if (!block->free[level].empty()) {
+                    stats.largestFree = std::max(stats.largestFree, m_blockSize >> level);
+                    break;
+                }
+            }
+        }
+    }
+
+    return stats;
+}
+
+uint32_t Allocator::levelFor(VkDeviceSize size, VkDeviceSize alignment) const {
+    VkDeviceSize needed = std::max({size, alignment, MIN_ALLOCATION});
+    uint32_t level = m_levels - 1;
+    while (level > 0 && (m_blockSize >> level) < needed)
+        level--;
+    return level;
+}
+
+bool Allocator::allocateFrom(Block& block, uint32_t level, VkDeviceSize size, void* userData,
+                             VkDeviceSize& offset) {
+    // Take the smallest free node that fits and split it down to size
+    uint32_t found = level + 1;
+    for (uint32_t l = level + 1; l-- > 0;) {
+        if (!block.free[l].empty()) {
+            found = l;
+            break;
+        }
+    }
+    if (found > level)
+        return false;
+
+    offset = *block.free[found].begin();
+    block.free[found].erase(block.free[found].begin());
+    for (uint32_t l = found; l < level; l++)
+        block.free[l + 1].insert(offset + (m_blockSize >> (l + 1)));
+
+    block.used[offset] = {level, size, userData};
+    block.usedBytes += size;
+    return true;
+}
+
+void Allocator::freeIn(Block& block, VkDeviceSize offset) {
+    auto it = block.used.find(offset);
+    if (it == block.used.end())
+        throw std::runtime_error("Freeing memory that was not allocated!");
+
+    uint32_t level = it->second.level;
+    block.usedBytes -= it->second.size;
+    block.used.erase(it);
+
+    // Merge with the buddy for as long as it is free too
+    while (level > 0) {
+        VkDeviceSize buddy = offset ^ (m_blockSize >> level);
+        auto& free = block.free[level];
+        auto found = free.find(buddy);
+        if (found == free.end())
+            break;
+        free.erase(found);
+        offset = std::min(offset, buddy);
+        level--;
+    }
+    block.free[level].insert(offset);
+}
+
+uint32_t Allocator::createBlock(uint32_t memoryType) {
+    auto block = std::make_unique<Block>();
+
+    VkMemoryAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = m_blockSize;
+    allocInfo.memoryTypeIndex = memoryType;
+    if (vkAllocateMemory(m_device, &allocInfo, nullptr, &block->memory) != VK_SUCCESS)
+        throw std::runtime_error("Failed to allocate memory block!");
+
+    if (m_properties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+        vkMapMemory(m_device, block->memory, 0, m_blockSize, 0, &block->mapped);
+
+    block->free.resize(m_levels);
+    block->free[0].insert(0);
+
+    // Reuse a released slot so indices held by live allocations stay valid
+    auto& blocks = m_blocks[memoryType];
+    auto slot = std::find(blocks.begin(), blocks.end(), nullptr);
+    if (slot == blocks.end())
+        slot = blocks.insert(blocks.end(), nullptr);
+    *slot = std::move(block);
+    return static_cast<uint32_t>(slot - blocks.begin());
+}
+
+Allocation Allocator::allocateDedicated(VkDeviceSize size, uint32_t memoryType) {
+    Allocation allocation;
+    allocation.size = size;
+    allocation.memoryType = memoryType;
+
+    VkMemoryAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryType;
+    if (vkAllocateMemory(m_device, &allocInfo, nullptr, &allocation.memory) != VK_SUCCESS)
+        throw std::runtime_error("Failed to allocate dedicated memory!");
+
+    if (m_properties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+        vkMapMemory(m_device, allocation.memory, 0, size, 0, &allocation.mapped);
+
+    m_dedicatedCount++;
+    m_dedicatedBytes += size;
+    return allocation;
+}
+
+Allocation Allocator::place(uint32_t memoryType, uint32_t blockIndex, VkDeviceSize offset, VkDeviceSize size) {
+    auto& block = *m_blocks[memoryType][blockIndex];
+
+    Allocation allocation;
+    allocation.memory = block.memory;
+    allocation.offset = offset;
+    allocation.size = size;
+    allocation.mapped = block.mapped ? static_cast<char*>(block.mapped) + offset : nullptr;
+    allocation.memoryType = memoryType;
+    allocation.block = blockIndex;
+    return allocation;
+}
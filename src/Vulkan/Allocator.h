@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+namespace vk {
+    // A range of device memory handed out by Allocator. Host visible memory stays mapped for its lifetime.
+    struct Allocation {
+        static constexpr uint32_t DEDICATED = UINT32_MAX;
+
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        void* mapped = nullptr;
+        uint32_t memoryType = 0;
+        uint32_t block = DEDICATED;
+    };
+
+    // Sub-allocates buffers out of large per memory type blocks with a buddy allocator. Anything at
+    // least half a block gets its own dedicated vkAllocateMemory instead.
+    class Allocator {
+    public:
+        static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64 * 1024 * 1024;
+        static constexpr VkDeviceSize MIN_ALLOCATION = 256;
+
+        struct Stats {
+            uint32_t blocks = 0;
+            uint32_t dedicated = 0;
+            uint32_t allocations = 0;
+            VkDeviceSize reserved = 0;
+            VkDeviceSize used = 0;
+            VkDeviceSize largestFree = 0;
+        };
+
+        // Where a live allocation should move to pack blocks tighter. The owner copies the contents,
+        // rebinds its resource to `to` and then frees `from`.
+        struct Relocation {
+            Allocation from;
+            Allocation to;
+            void* userData;
+        };
+
+        Allocator(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize blockSize = DEFAULT_BLOCK_SIZE);
+        ~Allocator();
+
+        Allocator(const Allocator&) = delete;
+        Allocator& operator=(const Allocator&) = delete;
+
+        Allocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags flags,
+                            void* userData = nullptr);
+        void free(Allocation& allocation);
+
+        uint32_t findMemoryType(uint32_t filter, VkMemoryPropertyFlags flags) const;
+
+        // Plans moves out of the emptiest blocks into free space elsewhere, up to maxBytes in total.
+        // Destinations are reserved on return, sources stay allocated until the owner frees them.
+        std::vector<Relocation> defragment(VkDeviceSize maxBytes);
+        // Returns blocks with nothing left in them to the driver
+        void releaseEmptyBlocks();
+
+        Stats stats() const;
+
+    private:
+        struct Block {
+            VkDeviceMemory memory = VK_NULL_HANDLE;
+            void* mapped = nullptr;
+            // Free node offsets per level, level 0 being the whole block
+            std::vector<std::set<VkDeviceSize>> free;
+            struct Node {
+                uint32_t level;
+                VkDeviceSize size;
+                void* userData;
+            };
+            std::unordered_map<VkDeviceSize, Node> used;
+            VkDeviceSize usedBytes = 0;
+        };
+
+        uint32_t levelFor(VkDeviceSize size, VkDeviceSize alignment) const;
+        bool allocateFrom(Block& block, uint32_t level, VkDeviceSize size, void* userData, VkDeviceSize& offset);
+        void freeIn(Block& block, VkDeviceSize offset);
+        uint32_t createBlock(uint32_t memoryType);
+        Allocation allocateDedicated(VkDeviceSize size, uint32_t memoryType);
+        Allocation place(uint32_t memoryType, uint32_t blockIndex, VkDeviceSize offset, VkDeviceSize size);
+
+        VkDevice m_device;
+        VkPhysicalDeviceMemoryProperties m_properties = {};
+        VkDeviceSize m_blockSize;
+        uint32_t m_levels;
+
+        mutable std::mutex m_mutex;
+        // Indexed by memory type, empty slots are blocks that were released
+        std::vector<std::vector<std::unique_ptr<Block>>> m_blocks;
+        uint32_t m_dedicatedCount = 0;
+        VkDeviceSize m_dedicatedBytes = 0;
+    };
+}
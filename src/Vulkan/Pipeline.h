@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "VkTraits.h"
+#include "Structure.h"
+
+namespace vk {
+    class ComputePipelineInfo : public VkTraits<ComputePipelineInfo, VkComputePipelineCreateInfo> {
+    private:
+        const Structure sType = Structure::PipelineCompute;
+    public:
+        const void* pNext = nullptr;
+        VkPipelineCreateFlags flags = {};
+        VkPipelineShaderStageCreateInfo stage = {};
+        VkPipelineLayout layout = VK_NULL_HANDLE;
+        VkPipeline basePipelineHandle = VK_NULL_HANDLE;
+        int32_t basePipelineIndex = -1;
+
+        ComputePipelineInfo(VkShaderModule module, VkPipelineLayout layout, const char* entry = "main")
+            : layout(layout) {
+            stage.sType = static_cast<VkStructureType>(Structure::PipelineShaderStage);
+            stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+            stage.module = module;
+            stage.pName = entry;
+        }
+    };
+}
@@ -0,0 +1,85 @@
+#include "PipelineCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+using namespace vk;
+
+namespace {
+    // VkPipelineCacheHeaderVersionOne, read field by field since the file makes no alignment promises
+    constexpr size_t HEADER_SIZE = 16 + VK_UUID_SIZE;
+
+    uint32_t readWord(const std::string& data, size_t offset) {
+        uint32_t word;
+        std::memcpy(&word, data.data() + offset, sizeof(word));
+        return word;
+    }
+}
+
+PipelineCache::PipelineCache(VkPhysicalDevice physicalDevice, VkDevice device, std::string path)
+    : m_device(device), m_path(std::move(path)) {
+    vkGetPhysicalDeviceProperties(physicalDevice, &m_properties);
+
+    std::string data;
+    std::ifstream file(m_path, std::ios::binary);
+    if (file.is_open())
+        data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+    m_warm = validHeader(data);
+    if (!data.empty() && !m_warm)
+        std::cerr << "Ignoring pipeline cache " << m_path << " from another device or driver" << std::endl;
+
+    VkPipelineCacheCreateInfo cacheInfo = {};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheInfo.initialDataSize = m_warm ? data.size() : 0;
+    cacheInfo.pInitialData = m_warm ? data.data() : nullptr;
+
+    if (vkCreatePipelineCache(m_device, &cacheInfo, nullptr, &m_cache) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create pipeline cache!");
+}
+
+PipelineCache::~PipelineCache() {
+    vkDestroyPipelineCache(m_device, m_cache, nullptr);
+}
+
+bool PipelineCache::validHeader(const std::string& data) const {
+    if (data.size() < HEADER_SIZE)
+        return false;
+
+    uint32_t headerSize = readWord(data, 0);
+    return headerSize >= HEADER_SIZE && headerSize <= data.size() &&
+           readWord(data, 4) == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+           readWord(data, 8) == m_properties.vendorID &&
+           readWord(data, 12) == m_properties.deviceID &&
+           std::memcmp(data.data() + 16, m_properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void PipelineCache::save() const {
+    size_t size = 0;
+    if (vkGetPipelineCacheData(m_device, m_cache, &size, nullptr) != VK_SUCCESS || size == 0)
+        return;
+    std::vector<char> data(size);
+    if (vkGetPipelineCacheData(m_device, m_cache, &size, data.data()) != VK_SUCCESS)
+        return;
+
+    // Losing the cache only costs the next launch its warm start, so failures are reported and dropped
+    auto temp = m_path + ".tmp";
+    {
+        std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+        file.write(data.data(), static_cast<std::streamsize>(size));
+        file.close();
+        if (file.fail()) {
+            std::cerr << "Failed to write pipeline cache " << temp << std::endl;
+            std::remove(temp.c_str());
+            return;
+        }
+    }
+    if (std::rename(temp.c_str(), m_path.c_str()) != 0) {
+        std::cerr << "Failed to replace pipeline cache " << m_path << std::endl;
+        std::remove(temp.c_str());
+    }
+}
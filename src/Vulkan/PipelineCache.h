@@ -0,0 +1,47 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include <vulkan/vulkan.h>
+
+namespace vk {
+    // A VkPipelineCache seeded from a file, so drivers can skip shader compilation on later launches.
+    // Data written by another device or driver version is ignored rather than handed to the driver.
+    class PipelineCache {
+    public:
+        PipelineCache(VkPhysicalDevice physicalDevice, VkDevice device, std::string path);
+        ~PipelineCache();
+
+        PipelineCache(const PipelineCache&) = delete;
+        PipelineCache& operator=(const PipelineCache&) = delete;
+
+        // Writes the cache next to the file and renames it over, so a crash never leaves half a cache
+        void save() const;
+
+        VkPipelineCache handle() const { return m_cache; }
+        // Whether the cache was seeded from disk
+        bool warm() const { return m_warm; }
+
+        // Runs create and reports how long it took against a cold or warm cache
+        template <typename Create>
+        void timed(const char* name, Create&& create) const {
+            auto start = std::chrono::steady_clock::now();
+            create();
+            auto ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "Created " << name << " in " << ms << " ms, " << (m_warm ? "warm" : "cold")
+                      << " pipeline cache" << std::endl;
+        }
+
+    private:
+        bool validHeader(const std::string& data) const;
+
+        VkDevice m_device;
+        VkPhysicalDeviceProperties m_properties = {};
+        std::string m_path;
+        VkPipelineCache m_cache = VK_NULL_HANDLE;
+        bool m_warm = false;
+    };
+}
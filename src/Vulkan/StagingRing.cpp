@@ -0,0 +1,24 @@
+#include "StagingRing.h"
+
+using namespace vk;
+
+bool StagingRing::reserve(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset) {
+    if (size > m_capacity)
+        return false;
+
+    uint64_t start = (m_head + alignment - 1) / alignment * alignment;
+    if (start % m_capacity + size > m_capacity)
+        start = (start / m_capacity + 1) * m_capacity;
+
+    if (start + size - m_tail > m_capacity)
+        return false;
+
+    m_head = start + size;
+    offset = start % m_capacity;
+    return true;
+}
+
+void StagingRing::release(uint64_t head) {
+    if (head > m_tail)
+        m_tail = head;
+}
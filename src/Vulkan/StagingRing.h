@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+
+namespace vk {
+    // Bookkeeping for a persistently mapped upload buffer used as a ring. Positions only ever grow,
+    // so a frame can remember head() at submit and hand it back to release() once its fence signals.
+    class StagingRing {
+    public:
+        explicit StagingRing(VkDeviceSize capacity = 0) : m_capacity(capacity) {}
+
+        // Finds room for size bytes, never straddling the end of the buffer
+        bool reserve(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset);
+        // Everything written before head is no longer read by the GPU
+        void release(uint64_t head);
+
+        uint64_t head() const { return m_head; }
+        VkDeviceSize capacity() const { return m_capacity; }
+        VkDeviceSize used() const { return m_head - m_tail; }
+
+    private:
+        VkDeviceSize m_capacity;
+        uint64_t m_head = 0;
+        uint64_t m_tail = 0;
+    };
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <cstdint>
+
+using BlockId = uint8_t;
+constexpr BlockId AIR = 0;
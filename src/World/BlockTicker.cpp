@@ -0,0 +1,214 @@
+#include "BlockTicker.h"
+
+#include <algorithm>
+#include <tuple>
+
+#include "../Threads/Scheduler.h"
+
+namespace {
+    uint64_t splitmix(uint64_t& state) {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    bool chunkLess(const glm::ivec3& a, const glm::ivec3& b) {
+        return std::tie(a.x, a.y, a.z) < std::tie(b.x, b.y, b.z);
+    }
+
+    int colour(const glm::ivec3& chunkPos) {
+        return (chunkPos.x & 1) | ((chunkPos.y & 1) << 1) | ((chunkPos.z & 1) << 2);
+    }
+
+    glm::ivec3 blockPos(const glm::ivec3& chunkPos, int index) {
+        int x = index % Chunk::SIZE;
+        int z = (index / Chunk::SIZE) % Chunk::SIZE;
+        int y = index / (Chunk::SIZE * Chunk::SIZE);
+        return {chunkPos.x * Chunk::SIZE + x, chunkPos.y * Chunk::SIZE + y, chunkPos.z * Chunk::SIZE + z};
+    }
+
+    int blockIndex(const glm::ivec3& pos) {
+        auto local = World::localPos(pos);
+        return Chunk::index(local.x, local.y, local.z);
+    }
+}
+
+TickContext::TickContext(BlockTicker& ticker, const glm::ivec3& chunkPos, uint64_t seed)
+    : m_ticker(ticker),
+      m_chunkPos(chunkPos),
+      m_chunk(ticker.m_world.getChunk(chunkPos)),
+      m_random(seed) {}
+
+BlockId TickContext::getBlock(const glm::ivec3& pos) const {
+    return m_ticker.m_world.getBlock(pos);
+}
+
+void TickContext::setBlock(const glm::ivec3& pos, BlockId block) {
+    m_changes++;
+    if (m_chunk && World::chunkPos(pos) == m_chunkPos) {
+        auto local = World::localPos(pos);
+        m_chunk->set(local.x, local.y, local.z, block);
+    } else {
+        m_deferredBlocks.emplace_back(pos, block);
+    }
+}
+
+void TickContext::schedule(const glm::ivec3& pos, int delay, int priority) {
+    m_deferredSchedules.push_back({pos, m_ticker.m_tick + std::max(delay, 1), priority});
+}
+
+uint64_t TickContext::tick() const {
+    return m_ticker.m_tick;
+}
+
+uint32_t TickContext::random() {
+    return static_cast<uint32_t>(splitmix(m_random));
+}
+
+BlockTicker::BlockTicker(World& world, Scheduler* scheduler, uint64_t seed)
+    : m_world(world),
+      m_scheduler(scheduler),
+      m_seed(seed) {}
+
+void BlockTicker::onScheduledTick(BlockId block, Handler handler) {
+    m_scheduledHandlers[block] = std::move(handler);
+}
+
+void BlockTicker::onRandomTick(BlockId block, Handler handler) {
+    m_randomHandlers[block] = std::move(handler);
+}
+
+void BlockTicker::schedule(const glm::ivec3& pos, int delay, int priority) {
+    push(m_ticks[World::chunkPos(pos)], blockIndex(pos), m_tick + std::max(delay, 1), priority);
+}
+
+void BlockTicker::notify(const glm::ivec3& pos, int delay) {
+    static const glm::ivec3 neighbours[] = {
+        {1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}
+    };
+
+    for (const auto& offset : neighbours) {
+        auto neighbour = pos + offset;
+        if (m_scheduledHandlers.count(m_world.getBlock(neighbour)))
+            schedule(neighbour, delay);
+    }
+}
+
+void BlockTicker::setActive(const glm::ivec3& chunkPos, bool active) {
+    if (active)
+        m_active.insert(chunkPos);
+    else
+        m_active.erase(chunkPos);
+}
+
+int BlockTicker::update(float dt) {
+    m_accumulator += dt;
+
+    int steps = 0;
+    while (m_accumulator >= TIMESTEP) {
+        step();
+        m_accumulator -= TIMESTEP;
+        steps++;
+    }
+
+    return steps;
+}
+
+void BlockTicker::step() {
+    m_tick++;
+
+    // Every chunk with something to do this tick, in a fixed order so results don't depend on hashing
+    std::vector<glm::ivec3> chunks;
+    for (auto& entry : m_ticks)
+        if (!entry.second.queue.empty() && entry.second.queue.top().due <= m_tick)
+            chunks.push_back(entry.first);
+    chunks.insert(chunks.end(), m_active.begin(), m_active.end());
+    std::sort(chunks.begin(), chunks.end(), chunkLess);
+    chunks.erase(std::unique(chunks.begin(), chunks.end()), chunks.end());
+
+    for (int phase = 0; phase < 8; phase++) {
+        std::vector<TickContext> contexts;
+        std::vector<ChunkTicks*> queues;
+        std::vector<char> active;
+        for (auto& chunkPos : chunks) {
+            if (colour(chunkPos) != phase)
+                continue;
+
+            uint64_t seed = m_seed ^ (m_tick * 0x9E3779B97F4A7C15ull) ^ ChunkPosHash()(chunkPos);
+            contexts.push_back(TickContext(*this, chunkPos, seed));
+            auto it = m_ticks.find(chunkPos);
+            queues.push_back(it != m_ticks.end() ? &it->second : nullptr);
+            active.push_back(static_cast<char>(m_active.count(chunkPos)));
+        }
+
+        if (contexts.empty())
+            continue;
+
+        int count = static_cast<int>(contexts.size());
+        if (m_scheduler && count > 1) {
+            auto futures = m_scheduler->runRange([&](int i) {
+                tickChunk(contexts[i], queues[i], active[i] != 0);
+            }, 0, count);
+        } else {
+            for (int i = 0; i < count; i++)
+                tickChunk(contexts[i], queues[i], active[i] != 0);
+        }
+
+        // Apply cross-chunk effects serially, in chunk order
+        for (auto& context : contexts) {
+            m_changes += context.m_changes;
+            for (auto& write : context.m_deferredBlocks)
+                m_world.setBlock(write.first, write.second);
+            for (auto& deferred : context.m_deferredSchedules)
+                push(m_ticks[World::chunkPos(deferred.pos)], blockIndex(deferred.pos), deferred.due, deferred.priority);
+        }
+    }
+}
+
+uint64_t BlockTicker::tick() const {
+    return m_tick;
+}
+
+uint64_t BlockTicker::changes() const {
+    return m_changes;
+}
+
+size_t BlockTicker::pending() const {
+    size_t total = 0;
+    for (auto& entry : m_ticks)
+        total += entry.second.queue.size();
+    return total;
+}
+
+void BlockTicker::push(ChunkTicks& ticks, int index, uint64_t due, int priority) {
+    auto local = static_cast<uint16_t>(index);
+    if (!ticks.pending.insert(local).second)
+        return;
+
+    ticks.queue.push({due, priority, ticks.order++, local});
+}
+
+void BlockTicker::tickChunk(TickContext& context, ChunkTicks* ticks, bool active) {
+    if (ticks) {
+        while (!ticks->queue.empty() && ticks->queue.top().due <= m_tick) {
+            auto scheduled = ticks->queue.top();
+            ticks->queue.pop();
+            ticks->pending.erase(scheduled.index);
+
+            auto pos = blockPos(context.m_chunkPos, scheduled.index);
+            auto handler = m_scheduledHandlers.find(context.getBlock(pos));
+            if (handler != m_scheduledHandlers.end())
+                handler->second(context, pos);
+        }
+    }
+
+    if (active && context.m_chunk && !context.m_chunk->empty() && !m_randomHandlers.empty()) {
+        for (int i = 0; i < RANDOM_TICKS_PER_CHUNK; i++) {
+            auto pos = blockPos(context.m_chunkPos, static_cast<int>(context.random() % Chunk::VOLUME));
+            auto handler = m_randomHandlers.find(context.getBlock(pos));
+            if (handler != m_randomHandlers.end())
+                handler->second(context, pos);
+        }
+    }
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "World.h"
+
+class Scheduler;
+class BlockTicker;
+
+// What a block tick handler may touch. Blocks in the ticking chunk are written directly, anything
+// in a neighbouring chunk is deferred until the current colour phase ends.
+class TickContext {
+public:
+    BlockId getBlock(const glm::ivec3& pos) const;
+    void setBlock(const glm::ivec3& pos, BlockId block);
+    void schedule(const glm::ivec3& pos, int delay, int priority = 0);
+
+    uint64_t tick() const;
+    uint32_t random();
+
+private:
+    friend class BlockTicker;
+
+    TickContext(BlockTicker& ticker, const glm::ivec3& chunkPos, uint64_t seed);
+
+    struct DeferredSchedule {
+        glm::ivec3 pos;
+        uint64_t due;
+        int priority;
+    };
+
+    BlockTicker& m_ticker;
+    glm::ivec3 m_chunkPos;
+    Chunk* m_chunk;
+    uint64_t m_random;
+    uint64_t m_changes = 0;
+
+    std::vector<std::pair<glm::ivec3, BlockId>> m_deferredBlocks;
+    std::vector<DeferredSchedule> m_deferredSchedules;
+};
+
+// Runs scheduled and random block updates. Chunks are split into 8 colours by the parity of their
+// coordinates; chunks of one colour are never adjacent, so each colour phase ticks its chunks in
+// parallel while handlers still read and write one chunk into their neighbours.
+class BlockTicker {
+public:
+    using Handler = std::function<void(TickContext& context, const glm::ivec3& pos)>;
+
+    static constexpr float TIMESTEP = 1.0f / 20.0f;
+    static constexpr int RANDOM_TICKS_PER_CHUNK = 3;
+
+    explicit BlockTicker(World& world, Scheduler* scheduler = nullptr, uint64_t seed = 0);
+
+    void onScheduledTick(BlockId block, Handler handler);
+    void onRandomTick(BlockId block, Handler handler);
+
+    void schedule(const glm::ivec3& pos, int delay, int priority = 0);
+    // Schedules the six neighbours of a block that just changed
+    void notify(const glm::ivec3& pos, int delay = 1);
+
+    // Random ticks only run in active chunks
+    void setActive(const glm::ivec3& chunkPos, bool active);
+
+    int update(float dt);
+    void step();
+
+    uint64_t tick() const;
+    size_t pending() const;
+    // Blocks handlers have written so far, it moving on means the world needs remeshing
+    uint64_t changes() const;
+
+private:
+    friend class TickContext;
+
+    struct ScheduledTick {
+        uint64_t due;
+        int priority;
+        uint64_t order;
+        uint16_t index;
+
+        // Earliest due first, then lowest priority, then first scheduled
+        bool operator>(const ScheduledTick& other) const {
+            if (due != other.due)
+                return due > other.due;
+            if (priority != other.priority)
+                return priority > other.priority;
+            return order > other.order;
+        }
+    };
+
+    struct ChunkTicks {
+        std::priority_queue<ScheduledTick, std::vector<ScheduledTick>, std::greater<>> queue;
+        std::unordered_set<uint16_t> pending;
+        uint64_t order = 0;
+    };
+
+    void push(ChunkTicks& ticks, int index, uint64_t due, int priority);
+    void tickChunk(TickContext& context, ChunkTicks* ticks, bool active);
+
+    World& m_world;
+    Scheduler* m_scheduler;
+    uint64_t m_seed;
+
+    std::unordered_map<BlockId, Handler> m_scheduledHandlers;
+    std::unordered_map<BlockId, Handler> m_randomHandlers;
+
+    std::unordered_map<glm::ivec3, ChunkTicks, ChunkPosHash> m_ticks;
+    std::unordered_set<glm::ivec3, ChunkPosHash> m_active;
+
+    float m_accumulator = 0.0f;
+    uint64_t m_tick = 0;
+    uint64_t m_changes = 0;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "Block.h"
+#include "Fluid.h"
+
+class Chunk {
+public:
+    static constexpr int SIZE_BITS = 4;
+    static constexpr int SIZE = 1 << SIZE_BITS;
+    static constexpr int VOLUME = SIZE * SIZE * SIZE;
+
+    BlockId get(int x, int y, int z) const {
+        return m_blocks[index(x, y, z)];
+    }
+
+    void set(int x, int y, int z, BlockId block) {
+        auto& current = m_blocks[index(x, y, z)];
+        m_blockCount += (block != AIR) - (current != AIR);
+        m_solidCount += isSolid(block) - isSolid(current);
+        current = block;
+    }
+
+    bool empty() const {
+        return m_blockCount == 0;
+    }
+
+    bool hasSolid() const {
+        return m_solidCount > 0;
+    }
+
+    static constexpr int index(int x, int y, int z) {
+        return (y * SIZE + z) * SIZE + x;
+    }
+
+private:
+    std::array<BlockId, VOLUME> m_blocks{};
+    int m_blockCount = 0;
+    int m_solidCount = 0;
+};
+
+struct ChunkPosHash {
+    size_t operator()(const glm::ivec3& pos) const {
+        return (static_cast<size_t>(pos.x) * 73856093) ^
+               (static_cast<size_t>(pos.y) * 19349663) ^
+               (static_cast<size_t>(pos.z) * 83492791);
+    }
+};
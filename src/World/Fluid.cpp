@@ -0,0 +1,70 @@
+#include "Fluid.h"
+
+#include <algorithm>
+
+#include "BlockTicker.h"
+
+namespace {
+    const glm::ivec3 horizontal[] = {{1, 0, 0}, {-1, 0, 0}, {0, 0, 1}, {0, 0, -1}};
+    const glm::ivec3 up{0, 1, 0};
+    const glm::ivec3 down{0, -1, 0};
+
+    // Level this block should have given what flows into it
+    int fedLevel(TickContext& context, const glm::ivec3& pos) {
+        if (Fluid::isWater(context.getBlock(pos + up)))
+            return Fluid::LEVELS - 1;
+
+        int best = 0;
+        for (const auto& offset : horizontal)
+            best = std::max(best, Fluid::level(context.getBlock(pos + offset)) - 1);
+        return best;
+    }
+
+    void flowInto(TickContext& context, const glm::ivec3& pos, int level) {
+        BlockId block = context.getBlock(pos);
+        if (block != AIR && !(Fluid::isWater(block) && Fluid::level(block) < level))
+            return;
+
+        context.setBlock(pos, Fluid::water(level));
+        context.schedule(pos, Fluid::FLOW_DELAY);
+    }
+
+    void tickWater(TickContext& context, const glm::ivec3& pos) {
+        int level = Fluid::level(context.getBlock(pos));
+
+        if (level < Fluid::LEVELS) {
+            int fed = fedLevel(context, pos);
+            if (fed != level) {
+                // Flowing water follows whatever feeds it, and dries up when nothing does
+                context.setBlock(pos, Fluid::water(fed));
+                for (const auto& offset : horizontal)
+                    if (Fluid::isWater(context.getBlock(pos + offset)))
+                        context.schedule(pos + offset, Fluid::FLOW_DELAY);
+                if (Fluid::isWater(context.getBlock(pos + down)))
+                    context.schedule(pos + down, Fluid::FLOW_DELAY);
+                if (fed == 0)
+                    return;
+                level = fed;
+            }
+        }
+
+        BlockId below = context.getBlock(pos + down);
+        if (below == AIR || (Fluid::isWater(below) && Fluid::level(below) < Fluid::LEVELS - 1)) {
+            flowInto(context, pos + down, Fluid::LEVELS - 1);
+            return;
+        }
+
+        if (level > 1 && !Fluid::isWater(below))
+            for (const auto& offset : horizontal)
+                flowInto(context, pos + offset, level - 1);
+    }
+}
+
+void Fluid::registerHandlers(BlockTicker& ticker) {
+    for (int level = 1; level <= LEVELS; level++)
+        ticker.onScheduledTick(water(level), tickWater);
+    // Flowing water also checks what feeds it now and then, so a flow cut off by a change nobody was
+    // notified about still dries up
+    for (int level = 1; level < LEVELS; level++)
+        ticker.onRandomTick(water(level), tickWater);
+}
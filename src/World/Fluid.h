@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Block.h"
+
+class BlockTicker;
+
+// Cellular water: a source block plus flowing levels that spread sideways one level weaker per block
+// and fall straight down at full strength. Levels are encoded in the block id.
+namespace Fluid {
+    constexpr int LEVELS = 8;
+    constexpr BlockId WATER = 16;
+    constexpr BlockId WATER_SOURCE = WATER + LEVELS - 1;
+    constexpr int FLOW_DELAY = 5;
+
+    constexpr bool isWater(BlockId block) {
+        return block >= WATER && block <= WATER_SOURCE;
+    }
+
+    // 1 for the thinnest flowing water up to LEVELS for a source, 0 if the block isn't water
+    constexpr int level(BlockId block) {
+        return isWater(block) ? block - WATER + 1 : 0;
+    }
+
+    constexpr BlockId water(int level) {
+        return level > 0 ? static_cast<BlockId>(WATER + level - 1) : AIR;
+    }
+
+    void registerHandlers(BlockTicker& ticker);
+}
+
+// Water is drawn and ticked like any other block but collides with nothing and lets rays through
+constexpr bool isSolid(BlockId block) {
+    return block != AIR && !Fluid::isWater(block);
+}
@@ -0,0 +1,208 @@
+#include "Raycast.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "../Threads/Scheduler.h"
+
+namespace {
+    constexpr float infinity = std::numeric_limits<float>::infinity();
+
+    // Remembers the last chunk visited so consecutive steps skip the hash lookup
+    class ChunkCursor {
+    public:
+        explicit ChunkCursor(const World& world) : m_world(world) {}
+
+        BlockId get(int x, int y, int z) {
+            glm::ivec3 pos(x, y, z);
+            auto cpos = World::chunkPos(pos);
+            if (!m_valid || cpos != m_chunkPos) {
+                m_chunk = m_world.getChunk(cpos);
+                m_chunkPos = cpos;
+                m_valid = true;
+            }
+
+            if (!m_chunk)
+                return AIR;
+
+            auto local = World::localPos(pos);
+            return m_chunk->get(local.x, local.y, local.z);
+        }
+
+    private:
+        const World& m_world;
+        const Chunk* m_chunk = nullptr;
+        glm::ivec3 m_chunkPos{0, 0, 0};
+        bool m_valid = false;
+    };
+
+    void setupAxis(float origin, float dir, int block, int& step, float& tMax, float& tDelta) {
+        if (dir > 0.0f) {
+            step = 1;
+            tDelta = 1.0f / dir;
+            tMax = (block + 1 - origin) * tDelta;
+        } else if (dir < 0.0f) {
+            step = -1;
+            tDelta = -1.0f / dir;
+            tMax = (origin - block) * tDelta;
+        } else {
+            step = 0;
+            tDelta = infinity;
+            tMax = infinity;
+        }
+    }
+
+    void tracePacket(const World& world, const Ray* rays, RayHit* hits, int count) {
+        // Structure of arrays so the stepping loop below vectorizes across lanes
+        alignas(32) float tMaxX[RAY_PACKET_SIZE], tMaxY[RAY_PACKET_SIZE], tMaxZ[RAY_PACKET_SIZE];
+        alignas(32) float tDeltaX[RAY_PACKET_SIZE], tDeltaY[RAY_PACKET_SIZE], tDeltaZ[RAY_PACKET_SIZE];
+        alignas(32) float t[RAY_PACKET_SIZE], maxDistance[RAY_PACKET_SIZE];
+        alignas(32) int stepX[RAY_PACKET_SIZE], stepY[RAY_PACKET_SIZE], stepZ[RAY_PACKET_SIZE];
+        alignas(32) int blockX[RAY_PACKET_SIZE], blockY[RAY_PACKET_SIZE], blockZ[RAY_PACKET_SIZE];
+        alignas(32) int axis[RAY_PACKET_SIZE];
+        alignas(32) int active[RAY_PACKET_SIZE];
+
+        ChunkCursor cursors[RAY_PACKET_SIZE] = {
+            ChunkCursor(world), ChunkCursor(world), ChunkCursor(world), ChunkCursor(world),
+            ChunkCursor(world), ChunkCursor(world), ChunkCursor(world), ChunkCursor(world)
+        };
+
+        for (int i = 0; i < count; i++)
+            hits[i] = {};
+
+        for (int i = 0; i < RAY_PACKET_SIZE; i++) {
+            if (i >= count || glm::dot(rays[i].dir, rays[i].dir) == 0.0f) {
+                // Padding lanes still run through the vector loop but never step
+                tMaxX[i] = tMaxY[i] = tMaxZ[i] = tDeltaX[i] = tDeltaY[i] = tDeltaZ[i] = infinity;
+                stepX[i] = stepY[i] = stepZ[i] = blockX[i] = blockY[i] = blockZ[i] = 0;
+                t[i] = maxDistance[i] = 0.0f;
+                axis[i] = -1;
+                active[i] = 0;
+                continue;
+            }
+
+            const auto& ray = rays[i];
+            auto dir = glm::normalize(ray.dir);
+            glm::ivec3 block(glm::floor(ray.origin));
+            setupAxis(ray.origin.x, dir.x, block.x, stepX[i], tMaxX[i], tDeltaX[i]);
+            setupAxis(ray.origin.y, dir.y, block.y, stepY[i], tMaxY[i], tDeltaY[i]);
+            setupAxis(ray.origin.z, dir.z, block.z, stepZ[i], tMaxZ[i], tDeltaZ[i]);
+            blockX[i] = block.x;
+            blockY[i] = block.y;
+            blockZ[i] = block.z;
+            t[i] = 0.0f;
+            maxDistance[i] = ray.maxDistance;
+            axis[i] = -1;
+            active[i] = 1;
+        }
+
+        int remaining = 0;
+        for (int i = 0; i < RAY_PACKET_SIZE; i++)
+            remaining += active[i];
+
+        while (remaining > 0) {
+            // Block lookups are gathers, so they stay scalar
+            for (int i = 0; i < RAY_PACKET_SIZE; i++) {
+                if (!active[i])
+                    continue;
+
+                BlockId type = cursors[i].get(blockX[i], blockY[i], blockZ[i]);
+                if (isSolid(type)) {
+                    auto& hit = hits[i];
+                    hit.hit = true;
+                    hit.type = type;
+                    hit.block = {blockX[i], blockY[i], blockZ[i]};
+                    hit.face = {0, 0, 0};
+                    if (axis[i] == 0)
+                        hit.face.x = -stepX[i];
+                    else if (axis[i] == 1)
+                        hit.face.y = -stepY[i];
+                    else if (axis[i] == 2)
+                        hit.face.z = -stepZ[i];
+                    hit.distance = t[i];
+                    active[i] = 0;
+                    remaining--;
+                }
+            }
+
+            // Branchless step of every lane along its nearest boundary
+            for (int i = 0; i < RAY_PACKET_SIZE; i++) {
+                int x = tMaxX[i] <= tMaxY[i] && tMaxX[i] <= tMaxZ[i];
+                int y = !x && tMaxY[i] <= tMaxZ[i];
+                int z = !x && !y;
+
+                t[i] = x ? tMaxX[i] : (y ? tMaxY[i] : tMaxZ[i]);
+                blockX[i] += x * stepX[i] * active[i];
+                blockY[i] += y * stepY[i] * active[i];
+                blockZ[i] += z * stepZ[i] * active[i];
+                tMaxX[i] += x ? tDeltaX[i] : 0.0f;
+                tMaxY[i] += y ? tDeltaY[i] : 0.0f;
+                tMaxZ[i] += z ? tDeltaZ[i] : 0.0f;
+                axis[i] = x ? 0 : (y ? 1 : 2);
+            }
+
+            for (int i = 0; i < RAY_PACKET_SIZE; i++) {
+                if (active[i] && t[i] > maxDistance[i]) {
+                    active[i] = 0;
+                    remaining--;
+                }
+            }
+        }
+    }
+}
+
+RayHit raycast(const World& world, const glm::vec3& origin, const glm::vec3& dir, float maxDistance) {
+    RayHit hit;
+    if (glm::dot(dir, dir) == 0.0f)
+        return hit;
+
+    auto d = glm::normalize(dir);
+    glm::ivec3 block(glm::floor(origin));
+    glm::ivec3 step;
+    glm::vec3 tMax;
+    glm::vec3 tDelta;
+    for (int i = 0; i < 3; i++)
+        setupAxis(origin[i], d[i], block[i], step[i], tMax[i], tDelta[i]);
+
+    ChunkCursor cursor(world);
+    glm::ivec3 face(0, 0, 0);
+    float t = 0.0f;
+    while (t <= maxDistance) {
+        BlockId type = cursor.get(block.x, block.y, block.z);
+        if (isSolid(type)) {
+            hit.hit = true;
+            hit.type = type;
+            hit.block = block;
+            hit.face = face;
+            hit.distance = t;
+            return hit;
+        }
+
+        int axis = tMax.x <= tMax.y ? (tMax.x <= tMax.z ? 0 : 2) : (tMax.y <= tMax.z ? 1 : 2);
+        t = tMax[axis];
+        block[axis] += step[axis];
+        tMax[axis] += tDelta[axis];
+        face = {0, 0, 0};
+        face[axis] = -step[axis];
+    }
+
+    return hit;
+}
+
+void raycast(const World& world, const Ray* rays, RayHit* hits, size_t count) {
+    for (size_t i = 0; i < count; i += RAY_PACKET_SIZE)
+        tracePacket(world, rays + i, hits + i, static_cast<int>(std::min<size_t>(RAY_PACKET_SIZE, count - i)));
+}
+
+void raycast(const World& world, const std::vector<Ray>& rays, std::vector<RayHit>& hits, Scheduler& scheduler) {
+    hits.resize(rays.size());
+    int packets = static_cast<int>((rays.size() + RAY_PACKET_SIZE - 1) / RAY_PACKET_SIZE);
+
+    auto futures = scheduler.runRange([&](int packet) {
+        size_t first = static_cast<size_t>(packet) * RAY_PACKET_SIZE;
+        raycast(world, rays.data() + first, hits.data() + first, std::min<size_t>(RAY_PACKET_SIZE, rays.size() - first));
+    }, 0, packets);
+
+    for (auto& future : futures)
+        future.get();
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "World.h"
+
+class Scheduler;
+
+struct Ray {
+    glm::vec3 origin;
+    glm::vec3 dir;
+    float maxDistance;
+};
+
+struct RayHit {
+    bool hit = false;
+    BlockId type = AIR;
+    glm::ivec3 block{0, 0, 0};
+    // Outward normal of the face the ray entered through, zero if the ray started inside the block
+    glm::ivec3 face{0, 0, 0};
+    float distance = 0.0f;
+};
+
+// Amanatides-Woo voxel traversal, stops at the first non-air block within maxDistance
+RayHit raycast(const World& world, const glm::vec3& origin, const glm::vec3& dir, float maxDistance);
+
+// Traces rays in packets of RAY_PACKET_SIZE with the traversal state laid out per lane
+constexpr int RAY_PACKET_SIZE = 8;
+void raycast(const World& world, const Ray* rays, RayHit* hits, size_t count);
+
+// Same as above, with packets spread over the scheduler's workers
+void raycast(const World& world, const std::vector<Ray>& rays, std::vector<RayHit>& hits, Scheduler& scheduler);
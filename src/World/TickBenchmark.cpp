@@ -0,0 +1,85 @@
+#include "TickBenchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "BlockTicker.h"
+#include "Fluid.h"
+#include "../Threads/Scheduler.h"
+
+namespace {
+    constexpr BlockId STONE = 3;
+
+    struct Result {
+        double ms;
+        uint64_t changes;
+        uint64_t checksum;
+    };
+
+    Result run(const std::vector<glm::ivec3>& chunks, uint32_t ticks, Scheduler* scheduler) {
+        // A stone floor along the bottom of each chunk with a source hanging over its middle, so the
+        // water falls, spreads across the floor and reaches into the neighbours
+        World world;
+        BlockTicker ticker(world, scheduler);
+        Fluid::registerHandlers(ticker);
+        for (auto& chunkPos : chunks) {
+            auto origin = chunkPos * Chunk::SIZE;
+            for (int x = 0; x < Chunk::SIZE; x++)
+                for (int z = 0; z < Chunk::SIZE; z++)
+                    world.setBlock(origin + glm::ivec3(x, 0, z), STONE);
+            auto source = origin + glm::ivec3(Chunk::SIZE / 2, Chunk::SIZE / 2, Chunk::SIZE / 2);
+            world.setBlock(source, Fluid::WATER_SOURCE);
+            ticker.schedule(source, 1);
+            ticker.setActive(chunkPos, true);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < ticks; i++)
+            ticker.step();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        // Ticking is deterministic, every run has to end with the same world
+        uint64_t checksum = 0xCBF29CE484222325ull;
+        for (auto& chunkPos : chunks) {
+            auto* chunk = world.getChunk(chunkPos);
+            for (int y = 0; y < Chunk::SIZE; y++)
+                for (int z = 0; z < Chunk::SIZE; z++)
+                    for (int x = 0; x < Chunk::SIZE; x++)
+                        checksum = (checksum ^ chunk->get(x, y, z)) * 0x100000001B3ull;
+        }
+        return {ms / ticks, ticker.changes(), checksum};
+    }
+}
+
+void benchmarkTicks(uint32_t chunks, uint32_t ticks) {
+    // Square of chunks on one layer
+    auto side = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(chunks))));
+    std::vector<glm::ivec3> positions;
+    for (uint32_t i = 0; i < chunks; i++)
+        positions.emplace_back(static_cast<int>(i) % side - side / 2, 0, static_cast<int>(i) / side - side / 2);
+
+    std::cout << "Ticking " << chunks << " active chunks for " << ticks << " ticks" << std::endl;
+
+    auto serial = run(positions, ticks, nullptr);
+    std::cout << "serial: " << serial.ms << " ms per tick, " << serial.changes << " block changes" << std::endl;
+
+    // Doubling up to as many workers as the default scheduler has
+    uint32_t maxThreads = std::max(std::thread::hardware_concurrency(), 2u) - 1u;
+    std::vector<uint32_t> threadCounts;
+    for (uint32_t threads = 1; threads < maxThreads; threads *= 2)
+        threadCounts.push_back(threads);
+    threadCounts.push_back(maxThreads);
+
+    for (auto threads : threadCounts) {
+        auto scheduler = std::make_unique<Scheduler>(threads);
+        auto result = run(positions, ticks, scheduler.get());
+        std::cout << threads << (threads == 1 ? " worker: " : " workers: ") << result.ms << " ms per tick, "
+                  << serial.ms / result.ms << "x" << (result.checksum != serial.checksum ? ", world differs!" : "")
+                  << std::endl;
+    }
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cstdint>
+
+// Floods a flat world of the given number of chunks from a water source in each, with every chunk active,
+// once serially and then on schedulers of growing size, and prints the tick timings
+void benchmarkTicks(uint32_t chunks, uint32_t ticks = 200);
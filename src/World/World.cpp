@@ -0,0 +1,41 @@
+#include "World.h"
+
+BlockId World::getBlock(const glm::ivec3& pos) const {
+    const Chunk* chunk = getChunk(chunkPos(pos));
+    if (!chunk)
+        return AIR;
+
+    auto local = localPos(pos);
+    return chunk->get(local.x, local.y, local.z);
+}
+
+void World::setBlock(const glm::ivec3& pos, BlockId block) {
+    auto cpos = chunkPos(pos);
+    Chunk* chunk = getChunk(cpos);
+    if (!chunk) {
+        // Don't allocate chunks just to clear a block in them
+        if (block == AIR)
+            return;
+        chunk = &getOrCreateChunk(cpos);
+    }
+
+    auto local = localPos(pos);
+    chunk->set(local.x, local.y, local.z, block);
+}
+
+Chunk* World::getChunk(const glm::ivec3& chunkPos) {
+    auto it = m_chunks.find(chunkPos);
+    return it != m_chunks.end() ? it->second.get() : nullptr;
+}
+
+const Chunk* World::getChunk(const glm::ivec3& chunkPos) const {
+    auto it = m_chunks.find(chunkPos);
+    return it != m_chunks.end() ? it->second.get() : nullptr;
+}
+
+Chunk& World::getOrCreateChunk(const glm::ivec3& chunkPos) {
+    auto& chunk = m_chunks[chunkPos];
+    if (!chunk)
+        chunk = std::make_unique<Chunk>();
+    return *chunk;
+}
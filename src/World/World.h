@@ -0,0 +1,29 @@
+#pragma once
+
+#include <memory>
+#include <unordered_map>
+
+#include <glm/glm.hpp>
+
+#include "Chunk.h"
+
+class World {
+public:
+    BlockId getBlock(const glm::ivec3& pos) const;
+    void setBlock(const glm::ivec3& pos, BlockId block);
+
+    Chunk* getChunk(const glm::ivec3& chunkPos);
+    const Chunk* getChunk(const glm::ivec3& chunkPos) const;
+    Chunk& getOrCreateChunk(const glm::ivec3& chunkPos);
+
+    static glm::ivec3 chunkPos(const glm::ivec3& blockPos) {
+        return {blockPos.x >> Chunk::SIZE_BITS, blockPos.y >> Chunk::SIZE_BITS, blockPos.z >> Chunk::SIZE_BITS};
+    }
+
+    static glm::ivec3 localPos(const glm::ivec3& blockPos) {
+        return {blockPos.x & (Chunk::SIZE - 1), blockPos.y & (Chunk::SIZE - 1), blockPos.z & (Chunk::SIZE - 1)};
+    }
+
+private:
+    std::unordered_map<glm::ivec3, std::unique_ptr<Chunk>, ChunkPosHash> m_chunks;
+};